@@ -7,5 +7,11 @@
 #define UNK_TOKEN "<UNK>"
 #define INITIAL_VOCAB_SIZE (1 << 20)  // ~1 million tokens
 #define INITIAL_PAIR_FREQ_SIZE 300
+#define STREAM_CHUNK_SIZE (1 << 20)   // Bytes per read in streaming training
+#define MAX_WORDS_IN_MEMORY (1 << 22) // Unique words counted before spilling a run
+#define MIN_SLOTS_PER_SHARD (1 << 16) // Smallest sequence shard worth a thread
+#define WORD_CACHE_SHARDS 16          // Locks in a word cache, so threads rarely share one
+#define SHARD_BUFFER_SIZE (1 << 22)   // Bytes of tokens written to a shard file at a time
+#define SHARD_ALIGNMENT 4096          // Alignment of the shard buffer and of the ids in a shard
 #endif
 
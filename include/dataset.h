@@ -53,6 +53,7 @@ void initialize_buffer(TextFile* file, size_t size);
 int resize_buffer(TextFile* file, size_t new_size);
 void clear_buffer(TextFile* file);
 int flush_buffer(TextFile* file);
+int read_next_chunk(TextFile* file, size_t chunk_size);
 //Dataset functions
 Dataset *initialize_dataset(size_t initial_capacity);
 int add_line(Dataset *dataset, const char *line);
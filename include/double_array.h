@@ -0,0 +1,35 @@
+#ifndef DOUBLE_ARRAY_H
+#define DOUBLE_ARRAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DOUBLE_ARRAY_NONE ((uint32_t)-1)
+
+/*
+ * Static byte trie in double-array form. The child of state s on byte c is
+ * t = base[s] + c, and it exists if check[t] == s. Walking a key is one
+ * add and one compare per byte, with no hashing or string comparison.
+ * State 0 is the root.
+ */
+typedef struct {
+        int32_t* base;
+        uint32_t* check;          // Parent state, DOUBLE_ARRAY_NONE for free slots
+        uint32_t* value;          // Value of the key ending here, DOUBLE_ARRAY_NONE if none
+        size_t size;              // Slots in each array
+} DoubleArray;
+
+typedef struct {
+        const char* bytes;
+        size_t length;
+        uint32_t value;
+} DoubleArrayKey;
+
+// Builds the trie of n distinct keys. Sorts keys in place.
+DoubleArray* build_double_array(DoubleArrayKey* keys, size_t n);
+void free_double_array(DoubleArray* trie);
+
+// Value of the key, or DOUBLE_ARRAY_NONE if it is not in the trie.
+uint32_t double_array_lookup(const DoubleArray* trie, const char* key, size_t length);
+
+#endif // DOUBLE_ARRAY_H
@@ -0,0 +1,141 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "tokenizer.h"
+#include "thread_pool.h"
+#include "word_cache.h"
+#include "double_array.h"
+
+// What merging a pair produces and how early it was learned.
+typedef struct {
+        uint32_t rank;            // Index in Tokenizer.merges, lower merges first
+        uint32_t merged;          // Id of the merged token
+} MergeRule;
+
+/*
+ * Read-only snapshot of a trained Tokenizer used for encoding. Nothing in it
+ * changes after freeze_tokenizer except the word cache, which locks itself,
+ * so one FrozenTokenizer can be shared by any number of threads.
+ */
+typedef struct {
+        bool byte_level;          // Base ids are byte values
+        PretokenizerMode pretokenizer; // Must match the mode the tokenizer was trained with
+        size_t num_ids;           // Ids are in [0, num_ids), the vocabulary slots
+        DoubleArray* base_ids;    // Character bytes -> id (character mode)
+        size_t* merge_rows;       // num_ids + 1 entries; rules for left id l are [merge_rows[l], merge_rows[l+1])
+        uint32_t* merge_rights;   // Right id of each rule, sorted within a row
+        MergeRule* merge_rules;   // Rule for (row, merge_rights[i])
+        size_t num_merges;
+        uint32_t separator;       // Id emitted between words, NO_TOKEN if none
+        char* text_pool;          // Texts of all ids back to back, not NUL terminated
+        size_t* text_offsets;     // num_ids + 1 entries; id i is text_pool[offsets[i], offsets[i+1])
+        WordCache* cache;         // Ids of recently encoded words, NULL if disabled
+} FrozenTokenizer;
+
+FrozenTokenizer* freeze_tokenizer(const Tokenizer* tokenizer);
+void free_frozen_tokenizer(FrozenTokenizer* frozen);
+
+// Puts a word cache of max_bytes in front of the merge loop, or removes it
+// if max_bytes is 0. Not thread safe; call before sharing frozen.
+int enable_word_cache(FrozenTokenizer* frozen, size_t max_bytes);
+
+// Rule for the pair (left, right), or NULL if the pair was never merged.
+const MergeRule* find_merge_rule(const FrozenTokenizer* frozen, uint32_t left, uint32_t right);
+
+/*
+ * Encodes length bytes of text into token ids. Text is split into words on
+ * spaces and newlines like in training, each word is split into base tokens,
+ * and merges are applied lowest rank first. Words are joined by the separator
+ * token. Characters that are not in the vocabulary are skipped. Returns a
+ * malloc'd array of *num_ids ids (possibly empty) or NULL on error.
+ */
+uint32_t* encode(const FrozenTokenizer* frozen, const char* text, size_t length, size_t* num_ids);
+
+// Bytes text[start, end) that a token was encoded from. A separator covers
+// the bytes between the two words around it.
+typedef struct {
+        size_t start;
+        size_t end;
+} TokenOffset;
+
+/*
+ * encode() that also returns the byte range of every id in *offsets, a
+ * malloc'd array parallel to the ids. The ranges are tracked through the
+ * merge loop, so there is no second pass; with offsets NULL this is encode().
+ */
+uint32_t* encode_with_offsets(const FrozenTokenizer* frozen, const char* text, size_t length, size_t* num_ids, TokenOffset** offsets);
+
+/*
+ * Scratch memory for one word of the merge loop. It only grows, so once it
+ * has seen the longest word of a workload, encoding allocates nothing. Use
+ * one arena per thread.
+ */
+typedef struct {
+        uint32_t* ids;
+        size_t* prev;
+        size_t* next;
+        TokenOffset* spans;       // Bytes of each id within the word, only filled for offsets
+        size_t capacity;          // Longest word the arrays hold
+        PriorityQueue* heap;
+        bool word_started;        // A word was emitted, so the next one needs a separator
+        size_t word_end;          // End offset of the last word, where a separator starts
+} EncodeArena;
+
+EncodeArena* create_encode_arena(void);
+void free_encode_arena(EncodeArena* arena);
+
+/*
+ * Encodes text like encode() into the caller's ids buffer, using only arena
+ * for working memory. Returns the number of ids the text encodes to; if it
+ * is more than capacity, only the first capacity ids are written and the
+ * caller can retry with a larger buffer. Returns (size_t)-1 on error. With a
+ * word cache enabled, cache misses still allocate the new cache entries.
+ * offsets, if not NULL, holds capacity entries and receives the byte range
+ * of each id written, as in encode_with_offsets().
+ */
+size_t encode_into(const FrozenTokenizer* frozen, const char* text, size_t length, uint32_t* ids, TokenOffset* offsets, size_t capacity, EncodeArena* arena);
+
+// Encodes a whole file; lines are joined by the separator like words.
+uint32_t* encode_file(const FrozenTokenizer* frozen, TextFile* file, size_t* num_ids);
+
+// Receives the ids of one chunk. A non-zero return stops the stream.
+typedef int (*EncodeSink)(void* context, const uint32_t* ids, size_t num_ids);
+
+/*
+ * Encodes file chunk_size bytes at a time and hands the ids of each chunk to
+ * sink. A word cut by a chunk boundary is carried over, so the ids are the
+ * same as encode() on the whole file. Memory does not depend on the file
+ * size; the one difference is that a run of more than chunk_size bytes with
+ * no space or newline is split into chunk_size words. Returns 0 or -1.
+ */
+int encode_stream(const FrozenTokenizer* frozen, TextFile* file, size_t chunk_size, EncodeSink sink, void* context);
+
+// Ids of a batch of texts, stored back to back.
+typedef struct {
+        uint32_t* ids;
+        size_t* offsets;          // num_texts + 1 entries; text i is ids[offsets[i], offsets[i+1])
+        size_t num_texts;
+} EncodedBatch;
+
+/*
+ * Encodes num_texts texts like encode(). lengths may be NULL for NUL
+ * terminated texts. The texts are cut into contiguous ranges that run on
+ * pool (inline if pool is NULL), so the output is the same for any number
+ * of threads. Returns NULL on error.
+ */
+EncodedBatch* encode_batch(const FrozenTokenizer* frozen, const char* const* texts, const size_t* lengths, size_t num_texts, ThreadPool* pool);
+void free_encoded_batch(EncodedBatch* batch);
+
+/*
+ * Writes the text of ids into buffer, snprintf style: at most buffer_size
+ * bytes are written, and the text is NUL terminated when there is room.
+ * Returns the length of the whole decoded text, so decode(frozen, ids, n,
+ * NULL, 0) + 1 is the buffer size needed. The separator decodes as a space.
+ * Returns (size_t)-1 if an id is out of range; empty slots decode to nothing.
+ */
+size_t decode(const FrozenTokenizer* frozen, const uint32_t* ids, size_t num_ids, char* buffer, size_t buffer_size);
+
+#endif // ENCODER_H
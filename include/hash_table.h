@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 // Core Operations that can be customized for different data types
@@ -74,6 +75,7 @@ void increment_frequency_hash_table(HashTable* hash_table, const char* key);
 
 // Retrieves the frequency of a given key
 int get_value(HashTable* hash_table, const void* key, void* dest);
+HashEntry* find_hash_entry(HashTable* hash_table, const void* key);
 
 void resize_hash_table(HashTable* hash_table);
 
@@ -83,6 +85,7 @@ bool validate_ops_func(HashTable* table);
 void reset_hash_table(HashTable* hash_table);
 size_t hash_function(const char* key, size_t capacity);
 size_t hash2(const char* key, size_t size);
+uint32_t murmur3_32(const uint8_t* key, size_t len, uint32_t seed);
 
 // String-specific operations for HashOperations
 size_t string_hash(const void* key);
@@ -93,5 +96,12 @@ void string_print(const void* key, FILE* stream);
 void int_print(const void* value,FILE* stream);
 void create_standard_ops(HashTable* table);
 
+// Operations for 64-bit integer keys (e.g. packed token id pairs)
+size_t uint64_hash(const void* key);
+int uint64_compare(const void* key1, const void* key2);
+void* uint64_duplicate(const void* key);
+void uint64_print(const void* key, FILE* stream);
+void create_uint64_ops(HashTable* table);
+
 #endif // HASH_TABLE_H
 
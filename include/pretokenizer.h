@@ -0,0 +1,101 @@
+#ifndef PRETOKENIZER_H
+#define PRETOKENIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_SIMD_DELIMITERS 8   // Larger sets are matched one byte at a time
+
+// How text is cut into the words BPE trains on and merges within.
+typedef enum {
+        PRETOKENIZE_SPACES = 0,   // Words are runs between spaces (and newlines)
+        PRETOKENIZE_GPT2          // Letters, digits, punctuation and whitespace runs, GPT-2 style
+} PretokenizerMode;
+
+// A word of the input: text[offset, offset + length).
+typedef struct {
+        size_t offset;
+        size_t length;
+} WordSpan;
+
+// Set of delimiter bytes. table is a 256-bit lookup table that works for any
+// set; sets of up to MAX_SIMD_DELIMITERS bytes are also kept as a list for
+// the SIMD compares.
+typedef struct {
+        uint8_t table[32];
+        char bytes[MAX_SIMD_DELIMITERS];
+        size_t num_bytes;         // Distinct delimiters, bytes is only used if <= MAX_SIMD_DELIMITERS
+} DelimiterSet;
+
+void make_delimiter_set(DelimiterSet* set, const char* delimiters);
+
+static inline bool is_delimiter(const DelimiterSet* set, unsigned char c){
+        return (set->table[c >> 3] >> (c & 7)) & 1;
+}
+
+/*
+ * Finds the next word at or after *position, the same way strtok() does:
+ * a word is a maximal run of non-delimiter bytes. Returns false once there
+ * are no words left. *position is advanced past the word.
+ */
+bool next_word_span(const DelimiterSet* set, const char* text, size_t length, size_t* position, WordSpan* span);
+
+/*
+ * Cuts one text into pre-tokens. In PRETOKENIZE_SPACES mode these are the
+ * words between spaces. In PRETOKENIZE_GPT2 mode they are, GPT-2 style, a
+ * contraction ('s 't 're 've 'm 'll 'd), or a run of letters, of digits or
+ * of other symbols with at most one leading space, or a run of whitespace.
+ * Like the GPT-2 pattern, a whitespace run before a word leaves its last
+ * space to that word. Newlines end a line and are never part of a
+ * pre-token, matching training on lines. Non-ASCII characters count as
+ * letters; invalid UTF-8 bytes count as symbols.
+ *
+ * GPT-2 mode classifies the text PRETOKEN_BLOCK_SIZE bytes at a time into a
+ * bit mask per character class, turns those into a mask of the bytes where
+ * a pre-token ends, and cuts PRETOKEN_BATCH pre-tokens at a time from it.
+ * Callers may write to the text between calls as long as they put it back.
+ */
+#define PRETOKEN_BLOCK_SIZE 64
+#define PRETOKEN_BATCH 32
+
+typedef struct {
+        PretokenizerMode mode;
+        const DelimiterSet* spaces;   // Word boundaries in PRETOKENIZE_SPACES mode
+        const char* text;
+        size_t length;
+        size_t position;          // Where the search for the next pre-token starts
+        size_t block;             // Offset of the classified block
+        uint64_t breaks;          // Bit per byte of the block past position that ends a pre-token
+        int last_class;           // Class of the last byte of the block, -1 before the text
+        bool last_blank;          // Whether that byte is a space
+        uint64_t carried_breaks;  // Breaks and non-breaks a contraction at the end of the
+        uint64_t carried_joins;   // block puts at the start of the next one
+        WordSpan spans[PRETOKEN_BATCH]; // Pre-tokens cut ahead, up to position
+        size_t num_spans;
+        size_t next_span;
+} Pretokenizer;
+
+void init_pretokenizer(Pretokenizer* pretokenizer, PretokenizerMode mode, const DelimiterSet* spaces, const char* text, size_t length);
+
+// Cuts the next batch of GPT-2 pre-tokens into spans. Returns false once
+// there are none left.
+bool fill_gpt2_spans(Pretokenizer* pretokenizer);
+
+static inline bool next_gpt2_span(Pretokenizer* pretokenizer, WordSpan* span){
+        if(pretokenizer->next_span == pretokenizer->num_spans && !fill_gpt2_spans(pretokenizer)){
+                return false;
+        }
+        *span = pretokenizer->spans[pretokenizer->next_span++];
+        return true;
+}
+
+// Next word or pre-token, or false once the text is used up.
+static inline bool next_pretoken(Pretokenizer* pretokenizer, WordSpan* span){
+        if(pretokenizer->mode == PRETOKENIZE_GPT2){
+                return next_gpt2_span(pretokenizer, span);
+        }
+        return next_word_span(pretokenizer->spaces, pretokenizer->text, pretokenizer->length, &pretokenizer->position, span);
+}
+
+#endif // PRETOKENIZER_H
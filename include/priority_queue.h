@@ -0,0 +1,36 @@
+#ifndef PRIORITY_QUEUE_H
+#define PRIORITY_QUEUE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// A single element of the queue. The queue never owns item.
+typedef struct {
+    size_t priority;     // Larger priorities are popped first
+    void* item;          // Caller data, e.g. a HashEntry* of pair_freqs
+} HeapNode;
+
+// Binary max-heap stored in a flat array.
+typedef struct PriorityQueue {
+    HeapNode* nodes;     // Heap ordered array of nodes
+    size_t size;         // Current number of nodes
+    size_t capacity;     // Allocated number of nodes
+    // Orders items of equal priority; a negative result pops a first.
+    // May be NULL, in which case ties are popped in no particular order.
+    int (*compare_items)(const void* a, const void* b);
+} PriorityQueue;
+
+PriorityQueue* create_priority_queue(size_t capacity, int (*compare_items)(const void* a, const void* b));
+void free_priority_queue(PriorityQueue* queue);
+void reset_priority_queue(PriorityQueue* queue);
+
+int push_priority_queue(PriorityQueue* queue, size_t priority, void* item);
+bool pop_priority_queue(PriorityQueue* queue, HeapNode* node);
+bool peek_priority_queue(const PriorityQueue* queue, HeapNode* node);
+
+// Appends a node without restoring the heap order. Call heapify_priority_queue
+// once all nodes are in; this builds the heap in O(n) instead of O(n log n).
+int append_priority_queue(PriorityQueue* queue, size_t priority, void* item);
+void heapify_priority_queue(PriorityQueue* queue);
+
+#endif // PRIORITY_QUEUE_H
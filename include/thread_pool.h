@@ -0,0 +1,38 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Work item run by the pool. index is in [0, num_tasks) and every index is
+// run exactly once per call to run_thread_pool.
+typedef void (*ThreadPoolTask)(void* context, size_t index);
+
+// Fixed set of worker threads that run indexed tasks. The thread calling
+// run_thread_pool works alongside the workers, so a pool of num_threads
+// starts num_threads - 1 threads and a pool of 1 runs everything inline.
+typedef struct ThreadPool {
+    pthread_t* threads;
+    size_t num_threads;       // Threads taking tasks, including the caller
+    size_t requested_threads; // What the pool was created with; num_threads is
+                              // smaller if some threads could not be started
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    ThreadPoolTask task;      // NULL while no batch is running
+    void* context;
+    size_t num_tasks;
+    size_t next_task;         // Next index to hand out
+    size_t tasks_done;
+    bool shutdown;
+} ThreadPool;
+
+ThreadPool* create_thread_pool(size_t num_threads);
+void free_thread_pool(ThreadPool* pool);
+
+// Runs task(context, i) for every i in [0, num_tasks) and returns once all of
+// them have finished. Tasks may run in any order and on any thread.
+int run_thread_pool(ThreadPool* pool, size_t num_tasks, ThreadPoolTask task, void* context);
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,98 @@
+#ifndef TOKEN_SHARD_H
+#define TOKEN_SHARD_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dataset.h"
+#include "encoder.h"
+
+#define TOKEN_SHARD_MAGIC "TOKSHRD1"
+
+/*
+ * Token shard files hold encoded corpora in a form a data loader can mmap:
+ *
+ *   [0, SHARD_ALIGNMENT)                 ShardHeader, zero padded
+ *   [tokens_offset, ...)                 num_tokens ids of dtype bytes each
+ *   [documents_offset, ...)              num_documents + 1 uint64_t token
+ *                                        indices; document d is tokens
+ *                                        [documents[d], documents[d+1])
+ *
+ * tokens_offset is SHARD_ALIGNMENT, so the ids start on a page boundary, and
+ * documents_offset is 8 byte aligned. Numbers are in native byte order.
+ */
+typedef enum {
+        SHARD_DTYPE_UINT16 = 2,   // Vocabularies of up to 65536 ids
+        SHARD_DTYPE_UINT32 = 4
+} ShardDtype;
+
+typedef struct {
+        char magic[8];            // TOKEN_SHARD_MAGIC
+        uint32_t dtype;           // Bytes per token, a ShardDtype
+        uint32_t reserved;
+        uint64_t vocab_size;      // Ids are below this
+        uint64_t num_tokens;
+        uint64_t num_documents;
+        uint64_t tokens_offset;   // File offset of the ids
+        uint64_t documents_offset; // File offset of the document index
+} ShardHeader;
+
+/*
+ * Encodes documents into numbered shards path_prefix_00000.bin, ...
+ * Tokens are converted to dtype in a SHARD_BUFFER_SIZE buffer aligned to
+ * SHARD_ALIGNMENT and written a full buffer at a time. A document is never
+ * split: a new shard starts once the current one has max_tokens_per_shard
+ * tokens (0 puts everything in one shard). Shards are written to a .tmp
+ * file and renamed when complete.
+ */
+typedef struct {
+        const FrozenTokenizer* frozen;
+        char* path_prefix;
+        ShardDtype dtype;
+        size_t max_tokens_per_shard;
+        size_t num_shards;        // Shards started so far
+        FILE* file;               // Current shard, NULL between shards
+        char* tmp_path;           // Where the current shard is written
+        unsigned char* buffer;
+        size_t buffer_used;
+        uint64_t num_tokens;      // Tokens in the current shard
+        uint64_t* documents;      // Start of each document of the current shard
+        size_t num_documents;
+        size_t documents_capacity;
+} ShardWriter;
+
+ShardWriter* create_shard_writer(const FrozenTokenizer* frozen, const char* path_prefix, ShardDtype dtype, size_t max_tokens_per_shard);
+
+// Encodes file as one document. Returns 0 or -1.
+int shard_writer_add_file(ShardWriter* writer, TextFile* file);
+
+// Finishes the last shard (an empty one if nothing was added) and frees the
+// writer. An unfinished shard is removed on error. Returns 0 or -1.
+int close_shard_writer(ShardWriter* writer);
+
+// Writes file, or every file of dataset in category order, as shards, one
+// document per file. Returns the number of shards or -1.
+int export_file_shards(const FrozenTokenizer* frozen, TextFile* file, const char* path_prefix, ShardDtype dtype, size_t max_tokens_per_shard);
+int export_dataset_shards(const FrozenTokenizer* frozen, Dataset* dataset, const char* path_prefix, ShardDtype dtype, size_t max_tokens_per_shard);
+
+// Read-only mapping of a shard file.
+typedef struct {
+        void* map;
+        size_t map_size;
+        const ShardHeader* header;
+        const void* tokens;       // header->num_tokens ids of header->dtype bytes
+        const uint64_t* documents; // header->num_documents + 1 entries
+} TokenShard;
+
+// Maps path and checks its header against the file size. NULL on error.
+TokenShard* open_token_shard(const char* path);
+void close_token_shard(TokenShard* shard);
+
+static inline uint32_t token_shard_id(const TokenShard* shard, size_t i){
+        if(shard->header->dtype == SHARD_DTYPE_UINT16){
+                return ((const uint16_t*)shard->tokens)[i];
+        }
+        return ((const uint32_t*)shard->tokens)[i];
+}
+
+#endif // TOKEN_SHARD_H
@@ -2,8 +2,12 @@
 #define TOKENIZER_H
 
 #include <stddef.h> // For size_t
+#include <stdint.h>
 #include "hash_table.h"
 #include "dataset.h"
+#include "priority_queue.h"
+#include "thread_pool.h"
+#include "pretokenizer.h"
 
 
 typedef struct {
@@ -11,6 +15,61 @@ typedef struct {
         size_t length;
         size_t frequency;
 } Token;
+// Value stored in pair_freqs. frequency must stay the first member: the
+// selection code reads counts as *(size_t*)entry->value.
+typedef struct {
+        size_t frequency;         // Current number of occurrences of the pair
+        size_t* positions;        // Indices where the pair started when it was counted (may be stale)
+        size_t num_positions;
+        size_t positions_capacity;
+} PairStats;
+
+#define NO_POSITION ((size_t)-1)
+#define NO_TOKEN ((uint32_t)-1)
+#define BYTE_ALPHABET_SIZE 256    // Base tokens of byte-level mode, id == byte value
+
+// Training works on token ids: the index of the token in the vocabulary.
+// pair_freqs is keyed on both ids packed into one 64-bit integer.
+static inline uint64_t create_pair_key(uint32_t left, uint32_t right){
+        return ((uint64_t)left << 32) | right;
+}
+static inline uint32_t pair_key_left(uint64_t key){ return (uint32_t)(key >> 32); }
+static inline uint32_t pair_key_right(uint64_t key){ return (uint32_t)key; }
+
+// Token id sequence used during training. Merges unlink the right token
+// instead of shifting the array; holes are compacted lazily. Tokens that can
+// never be part of a pair (separators, non printable text) are not stored at
+// all: the link between the tokens around them is simply left out, so a pair
+// exists exactly where next[i] != NO_POSITION.
+typedef struct {
+        uint32_t* ids;            // NO_TOKEN for slots removed by a merge
+        size_t* weights;          // Occurrences of the word the slot belongs to
+        size_t* prev;             // Previous linked slot or NO_POSITION
+        size_t* next;             // Next linked slot or NO_POSITION
+        size_t size;              // Number of slots in use
+        size_t capacity;          // Allocated slots
+        size_t live;              // Number of live tokens
+} TokenSequence;
+
+// Unique words of a corpus with their counts, in first occurrence order.
+typedef struct {
+        HashTable* index;         // word -> position in words
+        char** words;
+        size_t* counts;
+        size_t num_words;
+        size_t capacity;
+        size_t total;             // Sum of all counts
+} WordCounts;
+
+// One learned merge. Merges are stored in the order they were learned, so the
+// index in Tokenizer.merges is the merge rank.
+typedef struct {
+        uint32_t left;
+        uint32_t right;
+        uint32_t merged;
+        size_t frequency;         // Pair count when the merge was applied
+} BPEMerge;
+
 // Define the Tokenizer struct
 typedef struct {
     Token** vocabulary;        // Dynamic array of vocabulary tokens
@@ -18,24 +77,74 @@ typedef struct {
     size_t max_vocab_size;    // Maximum vocabulary size
     HashTable *pair_freqs;
     HashTable *token_map;
+    bool incremental_pairs;   // Update pair_freqs at merge sites instead of recounting every merge
+    bool deduplicate_words;   // Train on unique words weighted by their counts
+    bool byte_level;          // Base alphabet is the 256 byte values at fixed ids
+    PretokenizerMode pretokenizer; // How text is split into words before BPE
+    PriorityQueue *pair_queue; // Max-heap over pair_freqs entries, used with incremental_pairs
+    BPEMerge* merges;          // Learned merges in rank order
+    size_t num_merges;
+    size_t merges_capacity;
+    size_t num_threads;       // Threads used for pair counting, 1 counts serially
+    ThreadPool* thread_pool;  // Created on first parallel use
+    size_t stream_chunk_size;   // Bytes read at a time by BPE_streaming
+    size_t max_words_in_memory; // Unique words held before spilling to disk, 0 never spills
+    size_t merges_per_pass;     // Most merges learned per pair count without incremental_pairs
+    char* checkpoint_path;      // Where training saves checkpoints, NULL disables them
+    size_t checkpoint_every;    // Merges between checkpoints, 0 disables
+    double checkpoint_interval; // Seconds between checkpoints, 0 disables
 } Tokenizer;
 
 // Function declarations
 Tokenizer* create_tokenizer(size_t max_vocab_size);
 void add_to_vocabulary(Tokenizer* tokenizer, const char* token);
+void add_to_vocabulary_with_frequency(Tokenizer* tokenizer, const char* token, size_t frequency);
 Token** tokenize( TextFile* file, const char* delimiters, size_t* num_tokens);
+Token** tokenize_with_mode(TextFile* file, const char* delimiters, PretokenizerMode mode, size_t* num_tokens);
 void free_tokenizer(Tokenizer** tokenizer);
 char** split_by_character(const char* input);
+char** split_utf8_characters(const char* input, size_t* invalid);
 void free_tokens(Token** tokens, size_t num_tokens);
 char*** tokenize_dataset_to_characters(const char** dataset, size_t num_lines, const char* delimiter);
 void initialize_vocabulary(Tokenizer* tokenizer, TextFile* file);
 void initialize_freq(Tokenizer* tokenizer, size_t rows, size_t columns);
-void count_pairs(Tokenizer* tokenizer, Token** tokens, size_t num_tokens);
+void count_pairs(Tokenizer* tokenizer, const TokenSequence* sequence);
+int count_pairs_parallel(Tokenizer* tokenizer, const TokenSequence* sequence, size_t num_shards);
+int count_byte_pairs(Tokenizer* tokenizer, const TokenSequence* sequence);
+ThreadPool* get_thread_pool(Tokenizer* tokenizer);
 HashEntry* find_most_freq_pairs(HashTable* hash_table);
-char* create_pair_key(const char* token1, const char* token2);
 void BPE(Tokenizer* tokenizer, TextFile* dataset);
-char*  merge_most_freq_pair(Token** tokenized_data, HashEntry* most_freq_pair, size_t* size);
+void BPE_from_dataset(Tokenizer* tokenizer, Dataset* dataset);
+void BPE_streaming(Tokenizer* tokenizer, TextFile* dataset);
+int set_checkpointing(Tokenizer* tokenizer, const char* path, size_t every_merges, double every_seconds);
+int save_checkpoint(const Tokenizer* tokenizer, const TokenSequence* sequence, const char* path);
+TokenSequence* load_checkpoint(Tokenizer* tokenizer, const char* path);
+int BPE_resume(Tokenizer* tokenizer, const char* path);
+WordCounts* count_dataset_words(Tokenizer* tokenizer, Dataset* dataset);
+void BPE_from_sequence(Tokenizer* tokenizer, TokenSequence* sequence);
+size_t merge_most_freq_pair(TokenSequence* sequence, HashEntry* most_freq_pair, uint32_t merged);
+size_t merge_most_freq_pair_incremental(Tokenizer* tokenizer, TokenSequence* sequence, HashEntry* most_freq_pair, uint32_t merged);
+TokenSequence* create_token_sequence(size_t capacity);
+int append_to_token_sequence(TokenSequence* sequence, uint32_t id, size_t weight, bool link_to_previous);
+TokenSequence* tokens_to_sequence(Tokenizer* tokenizer, Token** tokens, size_t num_tokens);
+TokenSequence* words_to_sequence(Tokenizer* tokenizer, const WordCounts* words);
+int seed_byte_vocabulary(Tokenizer* tokenizer);
+TokenSequence* file_to_byte_sequence(Tokenizer* tokenizer, TextFile* file);
+WordCounts* create_word_counts(size_t initial_capacity);
+void free_word_counts(WordCounts* counts);
+int add_word_count(WordCounts* counts, const char* word, size_t count);
+int add_line_words(WordCounts* counts, char* line, PretokenizerMode mode);
+WordCounts* count_words(TextFile* file, PretokenizerMode mode);
+WordCounts* count_words_streaming(TextFile* file, size_t chunk_size, size_t max_words, PretokenizerMode mode);
+void free_token_sequence(TokenSequence* sequence);
+void compact_token_sequence(TokenSequence* sequence, HashTable* pair_freqs);
+void update_pair_frequency(HashTable* pair_freqs, PriorityQueue* pair_queue, uint32_t left, uint32_t right, int64_t delta, size_t position);
+int add_merge(Tokenizer* tokenizer, uint32_t left, uint32_t right, uint32_t merged, size_t frequency);
+void free_pair_stats(void* value);
+void rebuild_pair_queue(Tokenizer* tokenizer);
+HashEntry* pop_most_freq_pair(Tokenizer* tokenizer);
 int insert_into_token_map(HashTable* table, const char* key, size_t value);
+int append_to_token_map(HashTable* table, const char* key, size_t value);
 Token** resize_tokens(Token** tokens, size_t* capacity);
 int add_token(Token** tokens, size_t* count, size_t* capacity, Token* token);
 bool validate_pairs(const char* current, const char* next);
@@ -51,6 +160,6 @@ int token_exists_in_vocabulary(Tokenizer* tokenizer,const char* text);
 Token* find_most_frequent_token_pair(Token** tokens, size_t num_tokens);
 void free_token_array(Token** tokens, size_t num_tokens);
 Token* create_token_with_frequency(const char* text, size_t freq);
-void add_merged_token(Tokenizer* tokenizer, const char* text, size_t freq);
+size_t add_merged_token(Tokenizer* tokenizer, const char* text, size_t freq);
 #endif // TOKENIZER_H
 
@@ -0,0 +1,26 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define UTF8_MAX_CHAR_LEN 4
+
+// Length of the leading run of ASCII bytes in text. Uses AVX2 or SSE2 when
+// the compiler targets them and a byte loop otherwise.
+size_t utf8_ascii_run(const char* text, size_t length);
+
+// Length in bytes of the well formed UTF-8 character at the start of text,
+// or 0 if the bytes there are not valid UTF-8 (overlong forms, surrogates,
+// code points above U+10FFFF, truncated or stray continuation bytes).
+size_t utf8_char_length(const char* text, size_t length);
+
+// Checks a whole buffer. On failure error_offset (if not NULL) receives the
+// offset of the first invalid byte.
+bool utf8_validate(const char* text, size_t length, size_t* error_offset);
+
+// Number of invalid sequences in text. Each invalid byte counts once, the
+// same way split_utf8_characters treats it.
+size_t utf8_count_invalid(const char* text, size_t length);
+
+#endif // UTF8_H
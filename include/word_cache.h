@@ -0,0 +1,78 @@
+#ifndef WORD_CACHE_H
+#define WORD_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define WORD_CACHE_MISS ((size_t)-1)
+#define WORD_CACHE_NONE ((size_t)-1)   // End of a bucket chain or of the LRU list
+
+// A cached word and its ids. word and ids share one allocation.
+typedef struct {
+        uint32_t hash;
+        uint32_t num_ids;
+        size_t length;            // Bytes in word
+        char* word;
+        uint32_t* ids;
+        size_t chain_next;        // Next entry in the same bucket
+        size_t lru_prev;          // Towards the most recently used entry
+        size_t lru_next;          // Towards the least recently used entry
+} WordCacheEntry;
+
+// One lock's worth of the cache. Entries live in a slab and are linked both
+// into hash chains and into an LRU list; free slots are chained through
+// chain_next.
+typedef struct {
+        pthread_mutex_t lock;
+        WordCacheEntry* entries;
+        size_t num_slots;         // Slots of entries in use or on the free list
+        size_t capacity;
+        size_t free_slot;         // First free slot, WORD_CACHE_NONE if none
+        size_t* buckets;          // Index of the first entry of each chain
+        size_t num_buckets;       // Power of two
+        size_t num_entries;
+        size_t lru_head;          // Most recently used
+        size_t lru_tail;          // Evicted first
+        size_t bytes;
+        size_t max_bytes;
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+} WordCacheShard;
+
+/*
+ * Bounded cache from a pre-tokenized word to the ids encode() gives it. Each
+ * shard has its own lock and byte budget; a word always goes to the shard
+ * picked by its hash, so threads encoding different words rarely meet.
+ * Every entry is charged its word, its ids and its bookkeeping, and least
+ * recently used entries are evicted to stay under the budget.
+ */
+typedef struct {
+        WordCacheShard* shards;
+        size_t num_shards;
+} WordCache;
+
+typedef struct {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t entries;
+        size_t bytes;
+} WordCacheStats;
+
+WordCache* create_word_cache(size_t max_bytes, size_t num_shards);
+void free_word_cache(WordCache* cache);
+
+// Copies the ids of word into ids (room for max_ids) and returns how many
+// there are, or WORD_CACHE_MISS if the word is not cached or does not fit.
+size_t word_cache_lookup(WordCache* cache, const char* word, size_t length, uint32_t* ids, size_t max_ids);
+
+// Caches the ids of word, evicting old entries as needed. Entries larger
+// than a shard's budget are not cached. Returns -1 if out of memory.
+int word_cache_insert(WordCache* cache, const char* word, size_t length, const uint32_t* ids, size_t num_ids);
+
+// Totals over all shards.
+WordCacheStats word_cache_stats(WordCache* cache);
+
+#endif // WORD_CACHE_H
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <double_array.h>
+
+/*
+ * double_array.c
+ *
+ * Builds the trie from sorted keys, depth first. Every node with children
+ * gets the smallest base at which all of its child slots are free. Tries here
+ * are small (the base characters of a vocabulary), so a linear search for the
+ * base from the first free slot is fast enough.
+ */
+
+#define DOUBLE_ARRAY_ALPHABET 256
+
+typedef struct {
+	DoubleArray* trie;
+	const DoubleArrayKey* keys;  // Sorted
+	size_t first_free;        // No free slot below this one
+} DoubleArrayBuild;
+
+// Byte order with prefixes first, so a node's own key precedes its children.
+static int compare_keys(const void* a, const void* b){
+	const DoubleArrayKey* x = (const DoubleArrayKey*)a;
+	const DoubleArrayKey* y = (const DoubleArrayKey*)b;
+	size_t common = x->length < y->length ? x->length : y->length;
+	int result = memcmp(x->bytes, y->bytes, common);
+	if(result != 0){
+		return result;
+	}
+	return (x->length > y->length) - (x->length < y->length);
+}
+
+static int reserve_slots(DoubleArray* trie, size_t size){
+	if(size <= trie->size){
+		return 0;
+	}
+	size_t new_size = trie->size ? trie->size : DOUBLE_ARRAY_ALPHABET;
+	while(new_size < size){
+		new_size *= 2;
+	}
+	int32_t* base = realloc(trie->base, new_size * sizeof(int32_t));
+	if(!base) return -1;
+	trie->base = base;
+	uint32_t* check = realloc(trie->check, new_size * sizeof(uint32_t));
+	if(!check) return -1;
+	trie->check = check;
+	uint32_t* value = realloc(trie->value, new_size * sizeof(uint32_t));
+	if(!value) return -1;
+	trie->value = value;
+	for(size_t i = trie->size; i < new_size; i++){
+		trie->base[i] = 0;
+		trie->check[i] = DOUBLE_ARRAY_NONE;
+		trie->value[i] = DOUBLE_ARRAY_NONE;
+	}
+	trie->size = new_size;
+	return 0;
+}
+
+static unsigned char byte_at(const DoubleArrayBuild* build, size_t k, size_t depth){
+	return (unsigned char)build->keys[k].bytes[depth];
+}
+
+// Places the children of state for the sorted keys [lo, hi), which all share
+// their first depth bytes.
+static int insert_node(DoubleArrayBuild* build, uint32_t state, size_t lo, size_t hi, size_t depth){
+	DoubleArray* trie = build->trie;
+	if(lo < hi && build->keys[lo].length == depth){
+		trie->value[state] = build->keys[lo].value;
+		lo++;
+	}
+	if(lo == hi){
+		return 0;
+	}
+
+	unsigned char labels[DOUBLE_ARRAY_ALPHABET];
+	size_t num_labels = 0;
+	for(size_t k = lo; k < hi; k++){
+		unsigned char c = byte_at(build, k, depth);
+		if(num_labels == 0 || labels[num_labels - 1] != c){
+			labels[num_labels++] = c;
+		}
+	}
+
+	// Smallest base whose child slots are all free. Slot 0 is the root, so
+	// bases start at 1.
+	while(build->first_free < trie->size && trie->check[build->first_free] != DOUBLE_ARRAY_NONE){
+		build->first_free++;
+	}
+	size_t base = build->first_free > labels[0] ? build->first_free - labels[0] : 1;
+	for(;; base++){
+		if(reserve_slots(trie, base + DOUBLE_ARRAY_ALPHABET) != 0){
+			return -1;
+		}
+		size_t l = 0;
+		while(l < num_labels && trie->check[base + labels[l]] == DOUBLE_ARRAY_NONE){
+			l++;
+		}
+		if(l == num_labels){
+			break;
+		}
+	}
+	trie->base[state] = (int32_t)base;
+	for(size_t l = 0; l < num_labels; l++){
+		trie->check[base + labels[l]] = state;
+	}
+
+	for(size_t k = lo; k < hi; ){
+		unsigned char c = byte_at(build, k, depth);
+		size_t end = k;
+		while(end < hi && byte_at(build, end, depth) == c){
+			end++;
+		}
+		if(insert_node(build, (uint32_t)(base + c), k, end, depth + 1) != 0){
+			return -1;
+		}
+		k = end;
+	}
+	return 0;
+}
+
+DoubleArray* build_double_array(DoubleArrayKey* keys, size_t n){
+	DoubleArray* trie = calloc(1, sizeof(DoubleArray));
+	if(!trie || reserve_slots(trie, DOUBLE_ARRAY_ALPHABET) != 0){
+		fprintf(stderr, "Error: Could not allocate double-array trie.\n");
+		free_double_array(trie);
+		return NULL;
+	}
+	qsort(keys, n, sizeof(DoubleArrayKey), compare_keys);
+
+	trie->check[0] = 0;  // The root is its own parent, so slot 0 is never a child
+	DoubleArrayBuild build = { .trie = trie, .keys = keys, .first_free = 1 };
+	if(insert_node(&build, 0, 0, n, 0) != 0){
+		fprintf(stderr, "Error: Could not allocate double-array trie.\n");
+		free_double_array(trie);
+		return NULL;
+	}
+	return trie;
+}
+
+void free_double_array(DoubleArray* trie){
+	if(!trie){
+		return;
+	}
+	free(trie->base);
+	free(trie->check);
+	free(trie->value);
+	free(trie);
+}
+
+uint32_t double_array_lookup(const DoubleArray* trie, const char* key, size_t length){
+	uint32_t state = 0;
+	for(size_t i = 0; i < length; i++){
+		if(trie->base[state] == 0){
+			return DOUBLE_ARRAY_NONE;  // No children
+		}
+		size_t next = (size_t)trie->base[state] + (unsigned char)key[i];
+		if(next >= trie->size || trie->check[next] != state){
+			return DOUBLE_ARRAY_NONE;
+		}
+		state = (uint32_t)next;
+	}
+	return trie->value[state];
+}
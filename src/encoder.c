@@ -0,0 +1,839 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <encoder.h>
+#include <hash_table.h>
+#include <double_array.h>
+#include <pretokenizer.h>
+#include <priority_queue.h>
+#include <utf8.h>
+#include <config.h>
+#include <debug.h>
+
+/*
+ * encoder.c
+ *
+ * Turns text into token ids with the merges learned by BPE(). Each word is
+ * split into base tokens, which are kept in a linked list. The candidate
+ * pairs sit in a min-heap ordered by (merge rank, position). The lowest rank
+ * pair is merged, and only the two pairs around it are looked up again, so a
+ * word of n tokens costs O(n log n). Heap nodes are not removed when a merge
+ * makes them stale; they are checked again when popped, as in training.
+ */
+
+#define ENCODE_INITIAL_IDS 64
+#define BATCH_RANGES_PER_THREAD 4   // Ranges per thread, to even out long and short texts
+
+// Copies the vocabulary texts into one pool so decoding reads adjacent memory
+// instead of chasing a Token* per id.
+static int build_text_pool(FrozenTokenizer* frozen, const Tokenizer* tokenizer){
+	frozen->text_offsets = malloc((frozen->num_ids + 1) * sizeof(size_t));
+	if(!frozen->text_offsets){
+		return -1;
+	}
+	size_t total = 0;
+	for(size_t i = 0; i < frozen->num_ids; i++){
+		frozen->text_offsets[i] = total;
+		const Token* token = tokenizer->vocabulary[i];
+		if(token == NULL){
+			continue;
+		}
+		total += (uint32_t)i == frozen->separator && !frozen->byte_level ? 1 : token->length;
+	}
+	frozen->text_offsets[frozen->num_ids] = total;
+
+	frozen->text_pool = malloc(total + 1);
+	if(!frozen->text_pool){
+		return -1;
+	}
+	for(size_t i = 0; i < frozen->num_ids; i++){
+		size_t length = frozen->text_offsets[i + 1] - frozen->text_offsets[i];
+		if(length == 0){
+			continue;
+		}
+		// Spaces were replaced by the separator, so it decodes back to one.
+		const char* text = (uint32_t)i == frozen->separator && !frozen->byte_level ? " " : tokenizer->vocabulary[i]->text;
+		memcpy(frozen->text_pool + frozen->text_offsets[i], text, length);
+	}
+	return 0;
+}
+
+// Base tokens are the ones that hold exactly one character; invalid bytes
+// are single byte tokens.
+static int build_base_trie(FrozenTokenizer* frozen, const Tokenizer* tokenizer){
+	HashTable* token_map = tokenizer->token_map;
+	DoubleArrayKey* keys = malloc((token_map->size + 1) * sizeof(DoubleArrayKey));
+	if(!keys){
+		return -1;
+	}
+	size_t num_keys = 0;
+	for(size_t i = 0; i < token_map->capacity; i++){
+		HashEntry* entry = token_map->entries[i];
+		if(!entry || !entry->is_occupied){
+			continue;
+		}
+		const char* text = (const char*)entry->key;
+		size_t length = strlen(text);
+		if(length == 0 || (length != 1 && utf8_char_length(text, length) != length)){
+			continue;
+		}
+		keys[num_keys].bytes = text;
+		keys[num_keys].length = length;
+		keys[num_keys].value = (uint32_t)*(size_t*)entry->value;
+		num_keys++;
+	}
+	frozen->base_ids = build_double_array(keys, num_keys);
+	free(keys);
+	return frozen->base_ids ? 0 : -1;
+}
+
+typedef struct {
+	uint32_t left;
+	uint32_t right;
+	MergeRule rule;
+} RankedMerge;
+
+// Orders merges by pair, and by rank within a pair.
+static int compare_ranked_merges(const void* a, const void* b){
+	const RankedMerge* x = (const RankedMerge*)a;
+	const RankedMerge* y = (const RankedMerge*)b;
+	if(x->left != y->left) return x->left < y->left ? -1 : 1;
+	if(x->right != y->right) return x->right < y->right ? -1 : 1;
+	return x->rule.rank < y->rule.rank ? -1 : 1;
+}
+
+// Lays the merges out as a CSR table: one row of rules per left id, sorted
+// by right id.
+static int build_merge_table(FrozenTokenizer* frozen, const Tokenizer* tokenizer){
+	size_t num_merges = tokenizer->num_merges;
+	RankedMerge* merges = malloc((num_merges + 1) * sizeof(RankedMerge));
+	frozen->merge_rows = calloc(frozen->num_ids + 1, sizeof(size_t));
+	frozen->merge_rights = malloc((num_merges + 1) * sizeof(uint32_t));
+	frozen->merge_rules = malloc((num_merges + 1) * sizeof(MergeRule));
+	if(!merges || !frozen->merge_rows || !frozen->merge_rights || !frozen->merge_rules){
+		free(merges);
+		return -1;
+	}
+	for(size_t r = 0; r < num_merges; r++){
+		merges[r].left = tokenizer->merges[r].left;
+		merges[r].right = tokenizer->merges[r].right;
+		merges[r].rule.rank = (uint32_t)r;
+		merges[r].rule.merged = tokenizer->merges[r].merged;
+	}
+	qsort(merges, num_merges, sizeof(RankedMerge), compare_ranked_merges);
+
+	// A pair can come back after its merge if a later merge reuses an
+	// existing token; the first rank is the one training applied.
+	size_t num_rules = 0;
+	for(size_t k = 0; k < num_merges; k++){
+		if(k > 0 && merges[k].left == merges[k - 1].left && merges[k].right == merges[k - 1].right){
+			continue;
+		}
+		frozen->merge_rights[num_rules] = merges[k].right;
+		frozen->merge_rules[num_rules] = merges[k].rule;
+		frozen->merge_rows[merges[k].left + 1]++;
+		num_rules++;
+	}
+	for(size_t id = 0; id < frozen->num_ids; id++){
+		frozen->merge_rows[id + 1] += frozen->merge_rows[id];
+	}
+	free(merges);
+	return 0;
+}
+
+FrozenTokenizer* freeze_tokenizer(const Tokenizer* tokenizer){
+	if(tokenizer == NULL){
+		return NULL;
+	}
+	FrozenTokenizer* frozen = calloc(1, sizeof(FrozenTokenizer));
+	if(!frozen){
+		fprintf(stderr, "Error: Could not allocate frozen tokenizer.\n");
+		return NULL;
+	}
+	frozen->byte_level = tokenizer->byte_level;
+	frozen->pretokenizer = tokenizer->pretokenizer;
+	frozen->num_ids = tokenizer->max_vocab_size;
+	frozen->num_merges = tokenizer->num_merges;
+	frozen->separator = NO_TOKEN;
+	if(build_base_trie(frozen, tokenizer) != 0 || build_merge_table(frozen, tokenizer) != 0){
+		fprintf(stderr, "Error: Could not allocate frozen tokenizer.\n");
+		free_frozen_tokenizer(frozen);
+		return NULL;
+	}
+	if(frozen->pretokenizer == PRETOKENIZE_GPT2){
+		// Pre-tokens keep their spaces, so nothing goes between them.
+		frozen->separator = NO_TOKEN;
+	}else if(frozen->byte_level){
+		frozen->separator = ' ';
+	}else{
+		uint32_t separator = double_array_lookup(frozen->base_ids, "\x1f", 1);
+		frozen->separator = separator == DOUBLE_ARRAY_NONE ? NO_TOKEN : separator;
+	}
+	if(build_text_pool(frozen, tokenizer) != 0){
+		fprintf(stderr, "Error: Could not allocate the decoder string pool.\n");
+		free_frozen_tokenizer(frozen);
+		return NULL;
+	}
+	return frozen;
+}
+
+void free_frozen_tokenizer(FrozenTokenizer* frozen){
+	if(!frozen){
+		return;
+	}
+	free_double_array(frozen->base_ids);
+	free(frozen->merge_rows);
+	free(frozen->merge_rights);
+	free(frozen->merge_rules);
+	free(frozen->text_pool);
+	free(frozen->text_offsets);
+	free_word_cache(frozen->cache);
+	free(frozen);
+}
+
+int enable_word_cache(FrozenTokenizer* frozen, size_t max_bytes){
+	if(frozen == NULL){
+		return -1;
+	}
+	free_word_cache(frozen->cache);
+	frozen->cache = NULL;
+	if(max_bytes == 0){
+		return 0;
+	}
+	frozen->cache = create_word_cache(max_bytes, WORD_CACHE_SHARDS);
+	return frozen->cache ? 0 : -1;
+}
+
+const MergeRule* find_merge_rule(const FrozenTokenizer* frozen, uint32_t left, uint32_t right){
+	if(left >= frozen->num_ids){
+		return NULL;
+	}
+	// Rows are sorted by right id; most are short enough to scan.
+	size_t lo = frozen->merge_rows[left];
+	size_t end = frozen->merge_rows[left + 1];
+	size_t hi = end;
+	while(hi - lo > 8){
+		size_t mid = lo + (hi - lo) / 2;
+		if(frozen->merge_rights[mid] < right) lo = mid + 1;
+		else hi = mid + 1;  // mid may be the match
+	}
+	for(; lo < end && frozen->merge_rights[lo] <= right; lo++){
+		if(frozen->merge_rights[lo] == right){
+			return &frozen->merge_rules[lo];
+		}
+	}
+	return NULL;
+}
+
+size_t decode(const FrozenTokenizer* frozen, const uint32_t* ids, size_t num_ids, char* buffer, size_t buffer_size){
+	if(frozen == NULL || (ids == NULL && num_ids > 0) || (buffer == NULL && buffer_size > 0)){
+		return (size_t)-1;
+	}
+	const size_t* offsets = frozen->text_offsets;
+	size_t written = 0;
+	for(size_t i = 0; i < num_ids; i++){
+		if(ids[i] >= frozen->num_ids){
+			fprintf(stderr, "Error: Token id %u is not in the vocabulary.\n", ids[i]);
+			return (size_t)-1;
+		}
+		size_t start = offsets[ids[i]];
+		size_t length = offsets[ids[i] + 1] - start;
+		if(written + length <= buffer_size){
+			memcpy(buffer + written, frozen->text_pool + start, length);
+		}else if(written < buffer_size){
+			memcpy(buffer + written, frozen->text_pool + start, buffer_size - written);
+		}
+		written += length;
+	}
+	if(written < buffer_size){
+		buffer[written] = '\0';
+	}
+	return written;
+}
+
+typedef struct {
+	uint32_t* ids;
+	size_t size;
+	size_t capacity;
+	bool fixed;               // Caller's buffer: ids past capacity are counted, not stored
+	TokenOffset* offsets;     // Parallel to ids, NULL if offsets were not asked for
+} IdBuffer;
+
+static int push_id(IdBuffer* buffer, uint32_t id){
+	if(buffer->size >= buffer->capacity){
+		if(buffer->fixed){
+			buffer->size++;
+			return 0;
+		}
+		size_t new_capacity = buffer->capacity ? buffer->capacity * 2 : ENCODE_INITIAL_IDS;
+		uint32_t* ids = realloc(buffer->ids, new_capacity * sizeof(uint32_t));
+		if(!ids){
+			fprintf(stderr, "Error: Could not grow the id buffer.\n");
+			return -1;
+		}
+		buffer->ids = ids;
+		buffer->capacity = new_capacity;
+	}
+	buffer->ids[buffer->size++] = id;
+	return 0;
+}
+
+// push_id for buffers that also collect offsets.
+static int push_token(IdBuffer* buffer, uint32_t id, size_t start, size_t end){
+	if(buffer->size >= buffer->capacity && !buffer->fixed){
+		size_t new_capacity = buffer->capacity ? buffer->capacity * 2 : ENCODE_INITIAL_IDS;
+		TokenOffset* offsets = realloc(buffer->offsets, new_capacity * sizeof(TokenOffset));
+		if(!offsets){
+			fprintf(stderr, "Error: Could not grow the offset buffer.\n");
+			return -1;
+		}
+		buffer->offsets = offsets;
+	}
+	if(buffer->size < buffer->capacity || !buffer->fixed){
+		buffer->offsets[buffer->size] = (TokenOffset){ .start = start, .end = end };
+	}
+	return push_id(buffer, id);
+}
+
+static int reserve_scratch(EncodeArena* scratch, size_t length){
+	if(length <= scratch->capacity){
+		return 0;
+	}
+	uint32_t* ids = realloc(scratch->ids, length * sizeof(uint32_t));
+	if(!ids) return -1;
+	scratch->ids = ids;
+	size_t* prev = realloc(scratch->prev, length * sizeof(size_t));
+	if(!prev) return -1;
+	scratch->prev = prev;
+	size_t* next = realloc(scratch->next, length * sizeof(size_t));
+	if(!next) return -1;
+	scratch->next = next;
+	TokenOffset* spans = realloc(scratch->spans, length * sizeof(TokenOffset));
+	if(!spans) return -1;
+	scratch->spans = spans;
+	scratch->capacity = length;
+	return 0;
+}
+
+static void free_scratch(EncodeArena* scratch){
+	free(scratch->ids);
+	free(scratch->prev);
+	free(scratch->next);
+	free(scratch->spans);
+	free_priority_queue(scratch->heap);
+}
+
+// The heap is a max-heap, so invert (rank, position) to pop the lowest
+// rank first and, within a rank, the leftmost pair first.
+static size_t pair_priority(uint32_t rank, size_t position){
+	return ~(((size_t)rank << 32) | position);
+}
+
+static int push_candidate(const FrozenTokenizer* frozen, EncodeArena* scratch, size_t position){
+	size_t next = scratch->next[position];
+	if(next == NO_POSITION){
+		return 0;
+	}
+	const MergeRule* rule = find_merge_rule(frozen, scratch->ids[position], scratch->ids[next]);
+	if(rule == NULL){
+		return 0;
+	}
+	return push_priority_queue(scratch->heap, pair_priority(rule->rank, position), NULL);
+}
+
+// Splits word into base ids in scratch and returns how many there are. With
+// spans, the bytes of each base id are kept in scratch->spans.
+static size_t word_to_base_ids(const FrozenTokenizer* frozen, const char* word, size_t length, EncodeArena* scratch, bool spans){
+	size_t count = 0;
+	for(size_t i = 0; i < length; ){
+		if(frozen->byte_level){
+			if(spans) scratch->spans[count] = (TokenOffset){ .start = i, .end = i + 1 };
+			scratch->ids[count++] = (unsigned char)word[i++];
+			continue;
+		}
+		size_t char_length = utf8_char_length(word + i, length - i);
+		if(char_length == 0) char_length = 1;
+		uint32_t id = double_array_lookup(frozen->base_ids, word + i, char_length);
+		if(id != DOUBLE_ARRAY_NONE){
+			if(spans) scratch->spans[count] = (TokenOffset){ .start = i, .end = i + char_length };
+			scratch->ids[count++] = id;
+		}
+		i += char_length;
+	}
+	return count;
+}
+
+// Merges the base ids of word and leaves the result in scratch->ids[0,
+// count), and with spans the bytes of each id in scratch->spans. Returns
+// count, or (size_t)-1 on error.
+static size_t merge_word(const FrozenTokenizer* frozen, const char* word, size_t length, EncodeArena* scratch, bool spans){
+	size_t count = word_to_base_ids(frozen, word, length, scratch, spans);
+	if(count == 0){
+		return 0;
+	}
+	for(size_t i = 0; i < count; i++){
+		scratch->prev[i] = i == 0 ? NO_POSITION : i - 1;
+		scratch->next[i] = i + 1 == count ? NO_POSITION : i + 1;
+	}
+
+	reset_priority_queue(scratch->heap);
+	for(size_t i = 0; i + 1 < count; i++){
+		if(push_candidate(frozen, scratch, i) != 0) return (size_t)-1;
+	}
+	HeapNode node;
+	while(pop_priority_queue(scratch->heap, &node)){
+		size_t key = ~node.priority;
+		uint32_t rank = (uint32_t)(key >> 32);
+		size_t position = key & 0xFFFFFFFF;
+		size_t right = scratch->next[position];
+		if(scratch->ids[position] == NO_TOKEN || right == NO_POSITION){
+			continue; // merged away
+		}
+		const MergeRule* rule = find_merge_rule(frozen, scratch->ids[position], scratch->ids[right]);
+		if(rule == NULL || rule->rank != rank){
+			continue; // the pair at position changed since this node was pushed
+		}
+		scratch->ids[position] = rule->merged;
+		scratch->ids[right] = NO_TOKEN;
+		scratch->next[position] = scratch->next[right];
+		if(scratch->next[right] != NO_POSITION){
+			scratch->prev[scratch->next[right]] = position;
+		}
+		if(scratch->prev[position] != NO_POSITION && push_candidate(frozen, scratch, scratch->prev[position]) != 0) return (size_t)-1;
+		if(push_candidate(frozen, scratch, position) != 0) return (size_t)-1;
+	}
+
+	// Slot 0 always survives since merges write into the left slot, and the
+	// live slots only move left when compacted. A merged id covers the base
+	// slots up to the next live one, so its span ends where the last of them
+	// does.
+	size_t merged = 0;
+	for(size_t i = 0; i != NO_POSITION; i = scratch->next[i]){
+		if(spans){
+			size_t last = scratch->next[i] == NO_POSITION ? count - 1 : scratch->next[i] - 1;
+			scratch->spans[merged] = (TokenOffset){ .start = scratch->spans[i].start, .end = scratch->spans[last].end };
+		}
+		scratch->ids[merged++] = scratch->ids[i];
+	}
+	return merged;
+}
+
+// Spans of cached ids from their text lengths. Returns false if they do not
+// add up to the word, which happens when characters outside the vocabulary
+// were dropped; the word is merged again then to find where.
+static bool spans_from_lengths(const FrozenTokenizer* frozen, size_t length, EncodeArena* scratch, size_t count){
+	size_t position = 0;
+	for(size_t i = 0; i < count; i++){
+		uint32_t id = scratch->ids[i];
+		size_t end = position + frozen->text_offsets[id + 1] - frozen->text_offsets[id];
+		scratch->spans[i] = (TokenOffset){ .start = position, .end = end };
+		position = end;
+	}
+	return position == length;
+}
+
+// word starts at word_offset in the text being encoded; offsets are given
+// relative to that text.
+static int encode_word(const FrozenTokenizer* frozen, const char* word, size_t length, size_t word_offset, EncodeArena* scratch, IdBuffer* out){
+	if(reserve_scratch(scratch, length) != 0){
+		fprintf(stderr, "Error: Could not allocate encoder scratch space.\n");
+		return -1;
+	}
+	bool spans = out->offsets != NULL;
+	size_t count = WORD_CACHE_MISS;
+	if(frozen->cache){
+		count = word_cache_lookup(frozen->cache, word, length, scratch->ids, length);
+		if(count != WORD_CACHE_MISS && spans && !spans_from_lengths(frozen, length, scratch, count)){
+			count = merge_word(frozen, word, length, scratch, true);
+			if(count == (size_t)-1){
+				return -1;
+			}
+		}
+	}
+	if(count == WORD_CACHE_MISS){
+		count = merge_word(frozen, word, length, scratch, spans);
+		if(count == (size_t)-1){
+			return -1;
+		}
+		if(frozen->cache && word_cache_insert(frozen->cache, word, length, scratch->ids, count) != 0){
+			return -1;
+		}
+	}
+	if(count == 0){
+		return 0;
+	}
+
+	if(!spans){
+		if(scratch->word_started && frozen->separator != NO_TOKEN){
+			if(push_id(out, frozen->separator) != 0) return -1;
+		}
+		scratch->word_started = true;
+		for(size_t i = 0; i < count; i++){
+			if(push_id(out, scratch->ids[i]) != 0) return -1;
+		}
+		return 0;
+	}
+	// The separator covers the bytes between the two words.
+	if(scratch->word_started && frozen->separator != NO_TOKEN){
+		if(push_token(out, frozen->separator, scratch->word_end, word_offset) != 0) return -1;
+	}
+	scratch->word_started = true;
+	scratch->word_end = word_offset + length;
+	for(size_t i = 0; i < count; i++){
+		if(push_token(out, scratch->ids[i], word_offset + scratch->spans[i].start, word_offset + scratch->spans[i].end) != 0) return -1;
+	}
+	return 0;
+}
+
+static int encode_text(const FrozenTokenizer* frozen, const char* text, size_t length, EncodeArena* scratch, IdBuffer* out){
+	DelimiterSet delimiters;
+	make_delimiter_set(&delimiters, " \n");
+	Pretokenizer pretokenizer;
+	init_pretokenizer(&pretokenizer, frozen->pretokenizer, &delimiters, text, length);
+	WordSpan span;
+	while(next_pretoken(&pretokenizer, &span)){
+		if(encode_word(frozen, text + span.offset, span.length, span.offset, scratch, out) != 0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int init_encode(EncodeArena* scratch, IdBuffer* out, bool offsets){
+	memset(scratch, 0, sizeof(EncodeArena));
+	out->size = 0;
+	out->capacity = ENCODE_INITIAL_IDS;
+	out->fixed = false;
+	out->ids = malloc(out->capacity * sizeof(uint32_t));
+	out->offsets = offsets ? malloc(out->capacity * sizeof(TokenOffset)) : NULL;
+	scratch->heap = create_priority_queue(ENCODE_INITIAL_IDS, NULL);
+	if(!out->ids || (offsets && !out->offsets) || !scratch->heap){
+		fprintf(stderr, "Error: Could not allocate encoder buffers.\n");
+		free(out->ids);
+		free(out->offsets);
+		free_priority_queue(scratch->heap);
+		out->ids = NULL;
+		out->offsets = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static uint32_t* finish_encode(EncodeArena* scratch, IdBuffer* out, int result, size_t* num_ids){
+	free_scratch(scratch);
+	if(result != 0){
+		free(out->ids);
+		free(out->offsets);
+		*num_ids = 0;
+		return NULL;
+	}
+	*num_ids = out->size;
+	return out->ids;
+}
+
+uint32_t* encode(const FrozenTokenizer* frozen, const char* text, size_t length, size_t* num_ids){
+	if(frozen == NULL || text == NULL || num_ids == NULL){
+		return NULL;
+	}
+	return encode_with_offsets(frozen, text, length, num_ids, NULL);
+}
+
+uint32_t* encode_with_offsets(const FrozenTokenizer* frozen, const char* text, size_t length, size_t* num_ids, TokenOffset** offsets){
+	if(frozen == NULL || text == NULL || num_ids == NULL){
+		return NULL;
+	}
+	EncodeArena scratch;
+	IdBuffer out;
+	if(init_encode(&scratch, &out, offsets != NULL) != 0){
+		return NULL;
+	}
+	int result = encode_text(frozen, text, length, &scratch, &out);
+	uint32_t* ids = finish_encode(&scratch, &out, result, num_ids);
+	if(offsets){
+		*offsets = ids ? out.offsets : NULL;
+	}
+	return ids;
+}
+
+EncodeArena* create_encode_arena(void){
+	EncodeArena* arena = calloc(1, sizeof(EncodeArena));
+	if(!arena){
+		fprintf(stderr, "Error: Could not allocate encode arena.\n");
+		return NULL;
+	}
+	arena->heap = create_priority_queue(ENCODE_INITIAL_IDS, NULL);
+	if(!arena->heap || reserve_scratch(arena, ENCODE_INITIAL_IDS) != 0){
+		fprintf(stderr, "Error: Could not allocate encode arena.\n");
+		free_encode_arena(arena);
+		return NULL;
+	}
+	return arena;
+}
+
+void free_encode_arena(EncodeArena* arena){
+	if(!arena){
+		return;
+	}
+	free_scratch(arena);
+	free(arena);
+}
+
+size_t encode_into(const FrozenTokenizer* frozen, const char* text, size_t length, uint32_t* ids, TokenOffset* offsets, size_t capacity, EncodeArena* arena){
+	if(frozen == NULL || text == NULL || arena == NULL || (ids == NULL && capacity > 0)){
+		return (size_t)-1;
+	}
+	IdBuffer out = { .ids = ids, .size = 0, .capacity = capacity, .fixed = true, .offsets = offsets };
+	arena->word_started = false;
+	if(encode_text(frozen, text, length, arena, &out) != 0){
+		return (size_t)-1;
+	}
+	return out.size;
+}
+
+// GPT-2 pre-tokens can span spaces, so in that mode chunks are only cut at
+// newlines and the carry holds the rest of a line.
+static bool is_word_delimiter(const FrozenTokenizer* frozen, char c){
+	return c == '\n' || (c == ' ' && frozen->pretokenizer != PRETOKENIZE_GPT2);
+}
+
+// Part of a word cut by a chunk boundary. It never holds more than one
+// chunk, so a longer run without delimiters is encoded in chunk sized pieces.
+typedef struct {
+	char* bytes;
+	size_t length;
+	size_t capacity;
+} WordCarry;
+
+static int carry_bytes(const FrozenTokenizer* frozen, WordCarry* carry, const char* bytes, size_t length, EncodeArena* scratch, IdBuffer* out){
+	while(length > 0){
+		if(carry->length == carry->capacity){
+			if(encode_text(frozen, carry->bytes, carry->length, scratch, out) != 0){
+				return -1;
+			}
+			carry->length = 0;
+		}
+		size_t take = carry->capacity - carry->length;
+		if(take > length) take = length;
+		memcpy(carry->bytes + carry->length, bytes, take);
+		carry->length += take;
+		bytes += take;
+		length -= take;
+	}
+	return 0;
+}
+
+// Encodes one chunk. The word before its first delimiter finishes the
+// carried word, and the bytes after its last delimiter start the next one.
+static int encode_chunk(const FrozenTokenizer* frozen, const char* chunk, size_t length, WordCarry* carry, EncodeArena* scratch, IdBuffer* out){
+	size_t first = 0;
+	while(first < length && !is_word_delimiter(frozen, chunk[first])){
+		first++;
+	}
+	if(first == length){
+		return carry_bytes(frozen, carry, chunk, length, scratch, out);
+	}
+	if(carry_bytes(frozen, carry, chunk, first, scratch, out) != 0){
+		return -1;
+	}
+	if(carry->length > 0 && encode_text(frozen, carry->bytes, carry->length, scratch, out) != 0){
+		return -1;
+	}
+	carry->length = 0;
+
+	size_t last = length - 1;
+	while(!is_word_delimiter(frozen, chunk[last])){
+		last--;
+	}
+	if(last > first && encode_text(frozen, chunk + first + 1, last - first - 1, scratch, out) != 0){
+		return -1;
+	}
+	return carry_bytes(frozen, carry, chunk + last + 1, length - last - 1, scratch, out);
+}
+
+int encode_stream(const FrozenTokenizer* frozen, TextFile* file, size_t chunk_size, EncodeSink sink, void* context){
+	if(frozen == NULL || file == NULL || sink == NULL || chunk_size == 0){
+		return -1;
+	}
+	if(open_text_file(file, "r") == -1){
+		fprintf(stderr,"error opening textfile.\n");
+		return -1;
+	}
+	EncodeArena scratch;
+	IdBuffer out;
+	WordCarry carry = { .bytes = malloc(chunk_size), .length = 0, .capacity = chunk_size };
+	if(!carry.bytes || init_encode(&scratch, &out, false) != 0){
+		fprintf(stderr, "Error: Could not allocate stream encoder buffers.\n");
+		free(carry.bytes);
+		close_text_file(file);
+		return -1;
+	}
+	int result = 0;
+	int bytes = 0;
+	while(result == 0 && (bytes = read_next_chunk(file, chunk_size)) > 0){
+		out.size = 0;
+		result = encode_chunk(frozen, file->buffer, (size_t)bytes, &carry, &scratch, &out);
+		if(result == 0 && out.size > 0 && sink(context, out.ids, out.size) != 0){
+			result = -1;
+		}
+	}
+	// -1 is a read error or a failed buffer allocation, not the end of the
+	// file; the ids so far are only part of it.
+	if(result == 0 && bytes == -1){
+		fprintf(stderr, "Error: Could not read %s.\n", file->filepath);
+		result = -1;
+	}
+	if(result == 0 && carry.length > 0){
+		out.size = 0;
+		result = encode_text(frozen, carry.bytes, carry.length, &scratch, &out);
+		if(result == 0 && out.size > 0 && sink(context, out.ids, out.size) != 0){
+			result = -1;
+		}
+	}
+	close_text_file(file);
+	free(carry.bytes);
+	free(out.ids);
+	free_scratch(&scratch);
+	return result;
+}
+
+static int append_to_id_buffer(void* context, const uint32_t* ids, size_t num_ids){
+	IdBuffer* buffer = (IdBuffer*)context;
+	for(size_t i = 0; i < num_ids; i++){
+		if(push_id(buffer, ids[i]) != 0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+uint32_t* encode_file(const FrozenTokenizer* frozen, TextFile* file, size_t* num_ids){
+	if(frozen == NULL || file == NULL || num_ids == NULL){
+		return NULL;
+	}
+	IdBuffer out = { .ids = malloc(ENCODE_INITIAL_IDS * sizeof(uint32_t)), .size = 0, .capacity = ENCODE_INITIAL_IDS, .fixed = false };
+	if(!out.ids || encode_stream(frozen, file, STREAM_CHUNK_SIZE, append_to_id_buffer, &out) != 0){
+		free(out.ids);
+		*num_ids = 0;
+		return NULL;
+	}
+	*num_ids = out.size;
+	return out.ids;
+}
+
+typedef struct {
+	const FrozenTokenizer* frozen;
+	const char* const* texts;
+	const size_t* lengths;
+	size_t num_texts;
+	size_t num_ranges;
+	IdBuffer* outputs;        // One per range
+	size_t* counts;           // Ids per text
+	int* results;             // One per range
+} BatchJob;
+
+static void encode_batch_range(void* context, size_t range){
+	BatchJob* job = (BatchJob*)context;
+	size_t start = range * job->num_texts / job->num_ranges;
+	size_t end = (range + 1) * job->num_texts / job->num_ranges;
+	EncodeArena scratch;
+	IdBuffer* out = &job->outputs[range];
+	if(init_encode(&scratch, out, false) != 0){
+		job->results[range] = -1;
+		return;
+	}
+	int result = 0;
+	for(size_t t = start; t < end && result == 0; t++){
+		size_t before = out->size;
+		size_t length = job->lengths ? job->lengths[t] : strlen(job->texts[t]);
+		scratch.word_started = false;
+		result = encode_text(job->frozen, job->texts[t], length, &scratch, out);
+		job->counts[t] = out->size - before;
+	}
+	free_scratch(&scratch);
+	job->results[range] = result;
+}
+
+EncodedBatch* encode_batch(const FrozenTokenizer* frozen, const char* const* texts, const size_t* lengths, size_t num_texts, ThreadPool* pool){
+	if(frozen == NULL || (texts == NULL && num_texts > 0)){
+		return NULL;
+	}
+	size_t num_threads = pool ? pool->num_threads : 1;
+	size_t num_ranges = num_threads * BATCH_RANGES_PER_THREAD;
+	if(num_ranges > num_texts) num_ranges = num_texts;
+	if(num_ranges == 0) num_ranges = 1;
+
+	EncodedBatch* batch = malloc(sizeof(EncodedBatch));
+	BatchJob job = {
+		.frozen = frozen, .texts = texts, .lengths = lengths,
+		.num_texts = num_texts, .num_ranges = num_ranges,
+		.outputs = calloc(num_ranges, sizeof(IdBuffer)),
+		.counts = calloc(num_texts + 1, sizeof(size_t)),
+		.results = calloc(num_ranges, sizeof(int)),
+	};
+	if(!batch || !job.outputs || !job.counts || !job.results){
+		fprintf(stderr, "Error: Could not allocate batch encoder buffers.\n");
+		free(batch);
+		free(job.outputs);
+		free(job.counts);
+		free(job.results);
+		return NULL;
+	}
+	batch->ids = NULL;
+	batch->num_texts = num_texts;
+	batch->offsets = job.counts;  // turned into offsets below
+
+	if(pool && num_texts > 0){
+		run_thread_pool(pool, num_ranges, encode_batch_range, &job);
+	}else{
+		for(size_t r = 0; r < num_ranges; r++){
+			encode_batch_range(&job, r);
+		}
+	}
+
+	int result = 0;
+	size_t total = 0;
+	for(size_t r = 0; r < num_ranges; r++){
+		if(job.results[r] != 0) result = -1;
+		total += job.outputs[r].size;
+	}
+	if(result == 0){
+		batch->ids = malloc((total ? total : 1) * sizeof(uint32_t));
+		if(!batch->ids){
+			fprintf(stderr, "Error: Could not allocate batch ids.\n");
+			result = -1;
+		}
+	}
+	if(result == 0){
+		size_t written = 0;
+		for(size_t r = 0; r < num_ranges; r++){
+			memcpy(batch->ids + written, job.outputs[r].ids, job.outputs[r].size * sizeof(uint32_t));
+			written += job.outputs[r].size;
+		}
+		// Exclusive prefix sum of the counts, in place.
+		size_t offset = 0;
+		for(size_t t = 0; t <= num_texts; t++){
+			size_t count = batch->offsets[t];
+			batch->offsets[t] = offset;
+			offset += count;
+		}
+	}
+	for(size_t r = 0; r < num_ranges; r++){
+		free(job.outputs[r].ids);
+	}
+	free(job.outputs);
+	free(job.results);
+	if(result != 0){
+		free_encoded_batch(batch);
+		return NULL;
+	}
+	return batch;
+}
+
+void free_encoded_batch(EncodedBatch* batch){
+	if(!batch){
+		return;
+	}
+	free(batch->ids);
+	free(batch->offsets);
+	free(batch);
+}
@@ -110,6 +110,7 @@ HashTable* create_hash_table(size_t capacity) {
     table->size = 0;
     create_standard_ops(table);
     table->load_factor = 0;
+    table->allow_resize = true;
     return table;
 }
 
@@ -253,6 +254,29 @@ int get_value(HashTable* hash_table, const void* key, void* dest) {
 
     return -1; // Key not found
 }
+
+// Returns the entry stored under key, or NULL if the key is not in the table.
+// Unlike get_value the caller gets direct access to the stored value, which is
+// what frequency counters need to update a count in place.
+HashEntry* find_hash_entry(HashTable* hash_table, const void* key){
+	if(!hash_table || !key) return NULL;
+	if(!validate_ops_func(hash_table)) return NULL;
+	size_t index = hash_table->ops.hash_function(key) % hash_table->capacity;
+
+	size_t step = 0;
+	while(step < hash_table->capacity){
+		size_t probing_index = (index + step*step) % hash_table->capacity;
+		HashEntry* entry = hash_table->entries[probing_index];
+		if(entry == NULL){
+			return NULL;
+		}
+		if(entry->key != NULL && hash_table->ops.compare_keys(entry->key, key) == 0){
+			return entry;
+		}
+		step++;
+	}
+	return NULL;
+}
 // This function insert an HashEntry into the hash table given the key. Note that if the key already exist in the hash table, it simply update the entry's value to the new value.
 int insert_into_hash_table(HashTable* table, const void* key, const void* value, size_t key_size, size_t value_size){
 
@@ -270,7 +294,7 @@ int insert_into_hash_table(HashTable* table, const void* key, const void* value,
         resize_hash_table(table);
     }
 	// Check to make sure the load factor isn't too high
-	if(table->ops.print_key){
+	if((DEBUG_LEVEL & DEBUG_HASH_TABLE) && table->ops.print_key){
 		DEBUG_HASH("Insert attempt - Key: "); table->ops.print_key(key, stderr); fprintf(stderr,"\n");
 	}
     	DEBUG_HASH("Current state - Size: %zu, Capacity: %zu\n", table->size, table->capacity);
@@ -406,7 +430,9 @@ bool has_next(HashTableIterator* iterator){
 HashEntry* get_next(HashTableIterator* iterator){
 	if(!iterator || has_next(iterator) == false) return NULL;
 
-	for(size_t i = iterator->current_index + 1; i < iterator->table->capacity; i++){
+	// The first call has not visited any slot yet, so slot 0 must be included.
+	size_t start = iterator->items_returned == 0 ? 0 : iterator->current_index + 1;
+	for(size_t i = start; i < iterator->table->capacity; i++){
 		HashEntry* entry = iterator->table->entries[i];
 		if(entry && entry->is_occupied == true){
 			iterator->items_returned++;
@@ -468,6 +494,54 @@ void string_free(void* key){
 	free(key);
 }
 
+// 64-bit integer keys, used for packed (left, right) token id pairs.
+size_t uint64_hash(const void* key){
+	// splitmix64 finalizer: cheap and spreads the two packed ids over all bits.
+	uint64_t x = *(const uint64_t*)key;
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return (size_t)x;
+}
+
+int uint64_compare(const void* key1, const void* key2){
+	if(!key1 || !key2){
+		return -1;
+	}
+	uint64_t a = *(const uint64_t*)key1;
+	uint64_t b = *(const uint64_t*)key2;
+	return (a > b) - (a < b);
+}
+
+void* uint64_duplicate(const void* key){
+	if(!key) return NULL;
+
+	uint64_t* ret = malloc(sizeof(uint64_t));
+	if(!ret) return NULL;
+	memcpy(ret, key, sizeof(uint64_t));
+	return ret;
+}
+
+void uint64_print(const void* key, FILE* stream){
+	if(!key) return;
+	fprintf(stream, "%llu", (unsigned long long)*(const uint64_t*)key);
+}
+
+void create_uint64_ops(HashTable* table){
+	if(!table) return;
+
+	table->ops.hash_function = uint64_hash;
+	table->ops.compare_keys = uint64_compare;
+	table->ops.duplicate_key = uint64_duplicate;
+	table->ops.duplicate_value = duplicate_value;
+	table->ops.print_key = uint64_print;
+	table->ops.print_value = int_print;
+	table->ops.free_key = free;
+	table->ops.free_value = free;
+}
+
 void create_standard_ops(HashTable* table){
 	if(!table) return;
 
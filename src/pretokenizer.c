@@ -0,0 +1,391 @@
+#include <string.h>
+#include <pretokenizer.h>
+#include <utf8.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * pretokenizer.c
+ *
+ * Splits text into words without copying it. Small delimiter sets (spaces,
+ * spaces and newlines) are matched 32 (AVX2) or 16 (SSE2) bytes at a time:
+ * one compare per delimiter, OR'd together, then a movemask gives a bit per
+ * byte. Other sets, and the tail of the text, go through the lookup table.
+ *
+ * The GPT-2 style scanner works from bit masks instead of a regex. Each 64
+ * byte block is classified once, 32 (AVX2) or 16 (SSE2) bytes at a time,
+ * into a bit per byte for letters, digits, spaces, newlines and other
+ * symbols. Shifts and ORs of those give the bytes that start a pre-token,
+ * so a pre-token of ~5 bytes costs one count of trailing zeros rather than
+ * a branch per byte. Non-ASCII bytes need their neighbours to tell valid
+ * UTF-8 from invalid, so characters are decoded from each of them.
+ */
+
+void make_delimiter_set(DelimiterSet* set, const char* delimiters){
+	memset(set, 0, sizeof(DelimiterSet));
+	for(const unsigned char* c = (const unsigned char*)delimiters; *c != '\0'; c++){
+		if(is_delimiter(set, *c)){
+			continue;
+		}
+		set->table[*c >> 3] |= (uint8_t)(1u << (*c & 7));
+		if(set->num_bytes < MAX_SIMD_DELIMITERS){
+			set->bytes[set->num_bytes] = (char)*c;
+		}
+		set->num_bytes++;
+	}
+}
+
+#if defined(__AVX2__)
+static inline uint32_t delimiter_mask32(const DelimiterSet* set, const char* text){
+	__m256i chunk = _mm256_loadu_si256((const __m256i*)text);
+	__m256i hits = _mm256_setzero_si256();
+	for(size_t k = 0; k < set->num_bytes; k++){
+		hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(set->bytes[k])));
+	}
+	return (uint32_t)_mm256_movemask_epi8(hits);
+}
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+static inline uint32_t delimiter_mask16(const DelimiterSet* set, const char* text){
+	__m128i chunk = _mm_loadu_si128((const __m128i*)text);
+	__m128i hits = _mm_setzero_si128();
+	for(size_t k = 0; k < set->num_bytes; k++){
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(set->bytes[k])));
+	}
+	return (uint32_t)_mm_movemask_epi8(hits);
+}
+#endif
+
+// Index of the first byte in [i, length) that is (want == true) or is not
+// (want == false) a delimiter, or length if there is none.
+static size_t scan(const DelimiterSet* set, const char* text, size_t i, size_t length, bool want){
+#if defined(__AVX2__) || defined(__SSE2__)
+	if(set->num_bytes <= MAX_SIMD_DELIMITERS){
+#if defined(__AVX2__)
+		for(; i + 32 <= length; i += 32){
+			uint32_t mask = delimiter_mask32(set, text + i);
+			if(!want) mask = ~mask;
+			if(mask != 0){
+				return i + (size_t)__builtin_ctz(mask);
+			}
+		}
+#endif
+		for(; i + 16 <= length; i += 16){
+			uint32_t mask = delimiter_mask16(set, text + i);
+			if(!want) mask = ~mask & 0xFFFF;
+			if(mask != 0){
+				return i + (size_t)__builtin_ctz(mask);
+			}
+		}
+	}
+#endif
+	while(i < length && is_delimiter(set, (unsigned char)text[i]) != want){
+		i++;
+	}
+	return i;
+}
+
+bool next_word_span(const DelimiterSet* set, const char* text, size_t length, size_t* position, WordSpan* span){
+	size_t start = scan(set, text, *position, length, false);
+	if(start >= length){
+		*position = length;
+		return false;
+	}
+	size_t end = scan(set, text, start + 1, length, true);
+	span->offset = start;
+	span->length = end - start;
+	*position = end;
+	return true;
+}
+
+enum {
+	CHAR_LETTER,
+	CHAR_DIGIT,
+	CHAR_SPACE,
+	CHAR_NEWLINE,
+	CHAR_OTHER
+};
+
+// Bit per byte of a block for each class, and for the few single bytes the
+// rules look for. high marks the non-ASCII bytes, which are not classified
+// yet.
+typedef struct {
+	uint64_t letters;
+	uint64_t digits;
+	uint64_t spaces;
+	uint64_t newlines;
+	uint64_t blanks;
+	uint64_t quotes;
+	uint64_t high;
+} ByteMasks;
+
+#if defined(__AVX2__)
+// Same as classify16 below for text[0, 32).
+static inline void classify32(const char* text, unsigned shift, ByteMasks* masks){
+	__m256i chunk = _mm256_loadu_si256((const __m256i*)text);
+	__m256i folded = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+	__m256i letters = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + 26)), _mm256_add_epi8(folded, _mm256_set1_epi8((char)(0x80 - 'a'))));
+	__m256i digits = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + 10)), _mm256_add_epi8(chunk, _mm256_set1_epi8((char)(0x80 - '0'))));
+	__m256i newlines = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n'));
+	__m256i blanks = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' '));
+	__m256i quotes = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\''));
+	__m256i controls = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + 5)), _mm256_add_epi8(chunk, _mm256_set1_epi8((char)(0x80 - '\t'))));
+	__m256i spaces = _mm256_or_si256(blanks, _mm256_andnot_si256(newlines, controls));
+	masks->letters |= (uint64_t)(uint32_t)_mm256_movemask_epi8(letters) << shift;
+	masks->digits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(digits) << shift;
+	masks->spaces |= (uint64_t)(uint32_t)_mm256_movemask_epi8(spaces) << shift;
+	masks->newlines |= (uint64_t)(uint32_t)_mm256_movemask_epi8(newlines) << shift;
+	masks->blanks |= (uint64_t)(uint32_t)_mm256_movemask_epi8(blanks) << shift;
+	masks->quotes |= (uint64_t)(uint32_t)_mm256_movemask_epi8(quotes) << shift;
+	masks->high |= (uint64_t)(uint32_t)_mm256_movemask_epi8(chunk) << shift;
+}
+#endif
+
+#if defined(__SSE2__)
+// Adds text[0, 16) to the masks at bit shift. Ranges are tested with one
+// signed compare: adding 0x80 - low moves low..high to the bottom of the
+// signed range.
+static inline void classify16(const char* text, unsigned shift, ByteMasks* masks){
+	__m128i chunk = _mm_loadu_si128((const __m128i*)text);
+	__m128i folded = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+	__m128i letters = _mm_cmplt_epi8(_mm_add_epi8(folded, _mm_set1_epi8((char)(0x80 - 'a'))), _mm_set1_epi8((char)(0x80 + 26)));
+	__m128i digits = _mm_cmplt_epi8(_mm_add_epi8(chunk, _mm_set1_epi8((char)(0x80 - '0'))), _mm_set1_epi8((char)(0x80 + 10)));
+	__m128i newlines = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'));
+	__m128i blanks = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+	__m128i quotes = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\''));
+	// \t \n \v \f \r are 9 to 13.
+	__m128i controls = _mm_cmplt_epi8(_mm_add_epi8(chunk, _mm_set1_epi8((char)(0x80 - '\t'))), _mm_set1_epi8((char)(0x80 + 5)));
+	__m128i spaces = _mm_or_si128(blanks, _mm_andnot_si128(newlines, controls));
+	masks->letters |= (uint64_t)(uint32_t)_mm_movemask_epi8(letters) << shift;
+	masks->digits |= (uint64_t)(uint32_t)_mm_movemask_epi8(digits) << shift;
+	masks->spaces |= (uint64_t)(uint32_t)_mm_movemask_epi8(spaces) << shift;
+	masks->newlines |= (uint64_t)(uint32_t)_mm_movemask_epi8(newlines) << shift;
+	masks->blanks |= (uint64_t)(uint32_t)_mm_movemask_epi8(blanks) << shift;
+	masks->quotes |= (uint64_t)(uint32_t)_mm_movemask_epi8(quotes) << shift;
+	masks->high |= (uint64_t)(uint32_t)_mm_movemask_epi8(chunk) << shift;
+}
+#endif
+
+static inline int ascii_class(unsigned char c){
+	if((c | 0x20) >= 'a' && (c | 0x20) <= 'z') return CHAR_LETTER;
+	if(c >= '0' && c <= '9') return CHAR_DIGIT;
+	if(c == '\n') return CHAR_NEWLINE;
+	if(c == ' ' || (c >= '\t' && c <= '\r')) return CHAR_SPACE;
+	return CHAR_OTHER;
+}
+
+// Bits of the high bytes of text[block, ...) that belong to a valid UTF-8
+// character. Characters are decoded from each high byte not yet covered,
+// and the first may have started up to 3 bytes before the block.
+static uint64_t utf8_letter_mask(const Pretokenizer* pretokenizer, size_t block, uint64_t high){
+	const char* text = pretokenizer->text;
+	size_t length = pretokenizer->length;
+	uint64_t letters = 0;
+	size_t i = block;
+	while(i > 0 && block - i < 3 && ((unsigned char)text[i] & 0xC0) == 0x80){
+		i--;
+	}
+	if(i < block){
+		size_t n = utf8_char_length(text + i, length - i);
+		if(i + n > block){
+			letters = ((uint64_t)1 << (i + n - block)) - 1;
+			high &= ~letters;
+		}
+	}
+	while(high != 0){
+		size_t k = (size_t)__builtin_ctzll(high);
+		size_t n = utf8_char_length(text + block + k, length - block - k);
+		uint64_t bits = n > 0 ? (((uint64_t)1 << n) - 1) << k : (uint64_t)1 << k;
+		if(n > 0) letters |= bits;
+		high &= ~bits;
+	}
+	return letters;
+}
+
+// Length of the contraction ('s, 't, 're, 've, 'm, 'll, 'd) at text[i], or 0.
+static size_t contraction_length(const char* text, size_t i, size_t length){
+	if(text[i] != '\'' || i + 1 >= length){
+		return 0;
+	}
+	char a = text[i + 1];
+	if(a == 's' || a == 't' || a == 'm' || a == 'd'){
+		return 2;
+	}
+	if(i + 2 < length){
+		char b = text[i + 2];
+		if((a == 'r' && b == 'e') || (a == 'v' && b == 'e') || (a == 'l' && b == 'l')){
+			return 3;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Works out where the pre-tokens of the block at offset block end. A byte
+ * starts a pre-token when its class differs from the byte before it, with
+ * two exceptions for whitespace followed by a word: the last whitespace
+ * byte is split off the run, and if it is a space it starts the word
+ * instead. A pre-token starting with a contraction ends after it. Blocks
+ * have to be classified in order: the first byte is compared with the last
+ * one of the previous block, and a contraction there can reach into this
+ * one.
+ */
+static void classify_block(Pretokenizer* pretokenizer, size_t block){
+	const char* text = pretokenizer->text;
+	size_t length = pretokenizer->length;
+	const char* bytes = text + block;
+	size_t count = length - block;
+	char padded[PRETOKEN_BLOCK_SIZE];
+	if(count < PRETOKEN_BLOCK_SIZE){
+		memset(padded, 0, PRETOKEN_BLOCK_SIZE);
+		memcpy(padded, bytes, count);
+		bytes = padded;
+	}else{
+		count = PRETOKEN_BLOCK_SIZE;
+	}
+	uint64_t valid = count == PRETOKEN_BLOCK_SIZE ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1;
+	ByteMasks masks = {0};
+#if defined(__AVX2__)
+	classify32(bytes, 0, &masks);
+	classify32(bytes + 32, 32, &masks);
+#elif defined(__SSE2__)
+	for(unsigned k = 0; k < PRETOKEN_BLOCK_SIZE; k += 16){
+		classify16(bytes + k, k, &masks);
+	}
+#else
+	for(unsigned k = 0; k < count; k++){
+		unsigned char c = (unsigned char)bytes[k];
+		uint64_t bit = (uint64_t)1 << k;
+		int cls = ascii_class(c);
+		if(c >= 0x80) masks.high |= bit;
+		else if(cls == CHAR_LETTER) masks.letters |= bit;
+		else if(cls == CHAR_DIGIT) masks.digits |= bit;
+		else if(cls == CHAR_SPACE) masks.spaces |= bit;
+		else if(cls == CHAR_NEWLINE) masks.newlines |= bit;
+		if(c == ' ') masks.blanks |= bit;
+		if(c == '\'') masks.quotes |= bit;
+	}
+#endif
+	uint64_t letters = masks.letters & valid;
+	uint64_t digits = masks.digits & valid;
+	uint64_t spaces = masks.spaces & valid;
+	uint64_t newlines = masks.newlines & valid;
+	uint64_t blanks = masks.blanks & valid;
+	uint64_t high = masks.high & valid;
+	uint64_t others = valid & ~(letters | digits | spaces | newlines | high);
+	if(high != 0){
+		uint64_t utf8 = utf8_letter_mask(pretokenizer, block, high) & valid;
+		letters |= utf8;
+		others |= high & ~utf8;
+	}
+
+	int last = pretokenizer->last_class;
+	uint64_t same = (letters & ((letters << 1) | (uint64_t)(last == CHAR_LETTER))) |
+		(digits & ((digits << 1) | (uint64_t)(last == CHAR_DIGIT))) |
+		(spaces & ((spaces << 1) | (uint64_t)(last == CHAR_SPACE))) |
+		(others & ((others << 1) | (uint64_t)(last == CHAR_OTHER)));
+	uint64_t words = valid & ~(spaces | newlines);
+	size_t next = block + PRETOKEN_BLOCK_SIZE;
+	bool word_next = next < length && ascii_class((unsigned char)text[next]) != CHAR_SPACE && text[next] != '\n';
+	uint64_t before_word = (words >> 1) | ((uint64_t)word_next << (PRETOKEN_BLOCK_SIZE - 1));
+	uint64_t starts = (valid & ~newlines & ~same) | (spaces & before_word);
+	starts &= ~(((blanks & before_word) << 1) | (uint64_t)(pretokenizer->last_blank && (words & 1)));
+
+	// Contractions are rare: each quote that starts a pre-token is checked
+	// on its own, and the bytes up to its end no longer start one.
+	uint64_t breaks = (starts | newlines | pretokenizer->carried_breaks) & ~pretokenizer->carried_joins;
+	uint64_t carried_breaks = 0, carried_joins = 0;
+	for(uint64_t quotes = masks.quotes & starts; quotes != 0; quotes &= quotes - 1){
+		size_t q = (size_t)__builtin_ctzll(quotes);
+		size_t n = contraction_length(text, block + q, length);
+		for(size_t k = q + 1; n > 0 && k <= q + n; k++){
+			bool end = k == q + n;
+			if(k < PRETOKEN_BLOCK_SIZE){
+				breaks = end ? breaks | ((uint64_t)1 << k) : breaks & ~((uint64_t)1 << k);
+			}else if(end){
+				carried_breaks |= (uint64_t)1 << (k - PRETOKEN_BLOCK_SIZE);
+			}else{
+				carried_joins |= (uint64_t)1 << (k - PRETOKEN_BLOCK_SIZE);
+			}
+		}
+	}
+	pretokenizer->carried_breaks = carried_breaks;
+	pretokenizer->carried_joins = carried_joins;
+	pretokenizer->block = block;
+	pretokenizer->breaks = breaks & valid;
+
+	uint64_t top = (uint64_t)1 << (count - 1);
+	pretokenizer->last_blank = (blanks & top) != 0;
+	pretokenizer->last_class = (letters & top) ? CHAR_LETTER : (digits & top) ? CHAR_DIGIT :
+		(spaces & top) ? CHAR_SPACE : (newlines & top) ? CHAR_NEWLINE : CHAR_OTHER;
+}
+
+void init_pretokenizer(Pretokenizer* pretokenizer, PretokenizerMode mode, const DelimiterSet* spaces, const char* text, size_t length){
+	pretokenizer->mode = mode;
+	pretokenizer->spaces = spaces;
+	pretokenizer->text = text;
+	pretokenizer->length = length;
+	pretokenizer->position = 0;
+	pretokenizer->last_class = -1;
+	pretokenizer->last_blank = false;
+	pretokenizer->carried_breaks = 0;
+	pretokenizer->carried_joins = 0;
+	pretokenizer->num_spans = 0;
+	pretokenizer->next_span = 0;
+	if(mode == PRETOKENIZE_GPT2 && length > 0){
+		classify_block(pretokenizer, 0);
+		// The first pre-token starts at 0; only the breaks after it matter.
+		pretokenizer->breaks &= ~(uint64_t)1;
+	}
+}
+
+/*
+ * Pre-tokens run from one break to the next, and the ones that start at a
+ * newline are dropped. breaks holds the breaks of the block past position,
+ * so each pre-token costs a count of trailing zeros and clearing a bit.
+ */
+bool fill_gpt2_spans(Pretokenizer* pretokenizer){
+	const char* text = pretokenizer->text;
+	size_t length = pretokenizer->length;
+	size_t start = pretokenizer->position;
+	size_t block = pretokenizer->block;
+	uint64_t breaks = pretokenizer->breaks;
+	size_t count = 0;
+	while(start < length){
+		if(breaks == 0){
+			if(block + PRETOKEN_BLOCK_SIZE >= length){
+				if(text[start] != '\n'){
+					pretokenizer->spans[count].offset = start;
+					pretokenizer->spans[count].length = length - start;
+					count++;
+				}
+				start = length;
+				break;
+			}
+			classify_block(pretokenizer, block + PRETOKEN_BLOCK_SIZE);
+			block = pretokenizer->block;
+			breaks = pretokenizer->breaks;
+			continue;
+		}
+		size_t end = block + (size_t)__builtin_ctzll(breaks);
+		breaks &= breaks - 1;
+		// Written unconditionally, kept unless it starts at a newline.
+		pretokenizer->spans[count].offset = start;
+		pretokenizer->spans[count].length = end - start;
+		count += text[start] != '\n';
+		start = end;
+		if(count == PRETOKEN_BATCH){
+			break;
+		}
+	}
+	pretokenizer->position = start;
+	pretokenizer->breaks = breaks;
+	pretokenizer->num_spans = count;
+	pretokenizer->next_span = 0;
+	return count > 0;
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <priority_queue.h>
+
+/*
+ * priority_queue.c
+ *
+ * Binary max-heap used by BPE to pick the most frequent pair without scanning
+ * the whole pair table. Nodes are (priority, item) pairs; the queue does not
+ * know what the items are, so callers that change priorities simply push a
+ * new node and discard stale ones when they are popped (lazy invalidation).
+ */
+
+// Returns true if node a must be popped before node b.
+static bool node_before(const PriorityQueue* queue, const HeapNode* a, const HeapNode* b){
+	if(a->priority != b->priority){
+		return a->priority > b->priority;
+	}
+	if(queue->compare_items){
+		return queue->compare_items(a->item, b->item) < 0;
+	}
+	return false;
+}
+
+static void sift_up(PriorityQueue* queue, size_t index){
+	HeapNode node = queue->nodes[index];
+	while(index > 0){
+		size_t parent = (index - 1) / 2;
+		if(!node_before(queue, &node, &queue->nodes[parent])){
+			break;
+		}
+		queue->nodes[index] = queue->nodes[parent];
+		index = parent;
+	}
+	queue->nodes[index] = node;
+}
+
+static void sift_down(PriorityQueue* queue, size_t index){
+	HeapNode node = queue->nodes[index];
+	size_t size = queue->size;
+	while(true){
+		size_t child = 2 * index + 1;
+		if(child >= size){
+			break;
+		}
+		if(child + 1 < size && node_before(queue, &queue->nodes[child + 1], &queue->nodes[child])){
+			child++;
+		}
+		if(!node_before(queue, &queue->nodes[child], &node)){
+			break;
+		}
+		queue->nodes[index] = queue->nodes[child];
+		index = child;
+	}
+	queue->nodes[index] = node;
+}
+
+static int grow_priority_queue(PriorityQueue* queue){
+	size_t new_capacity = queue->capacity ? queue->capacity * 2 : 16;
+	HeapNode* nodes = realloc(queue->nodes, new_capacity * sizeof(HeapNode));
+	if(!nodes){
+		fprintf(stderr, "Error: Could not grow priority queue to %zu nodes.\n", new_capacity);
+		return -1;
+	}
+	queue->nodes = nodes;
+	queue->capacity = new_capacity;
+	return 0;
+}
+
+PriorityQueue* create_priority_queue(size_t capacity, int (*compare_items)(const void* a, const void* b)){
+	PriorityQueue* queue = malloc(sizeof(PriorityQueue));
+	if(!queue){
+		fprintf(stderr, "Error: Could not allocate priority queue.\n");
+		return NULL;
+	}
+	if(capacity == 0){
+		capacity = 16;
+	}
+	queue->nodes = malloc(capacity * sizeof(HeapNode));
+	if(!queue->nodes){
+		fprintf(stderr, "Error: Could not allocate priority queue nodes.\n");
+		free(queue);
+		return NULL;
+	}
+	queue->size = 0;
+	queue->capacity = capacity;
+	queue->compare_items = compare_items;
+	return queue;
+}
+
+void free_priority_queue(PriorityQueue* queue){
+	if(!queue){
+		return;
+	}
+	free(queue->nodes);
+	free(queue);
+}
+
+void reset_priority_queue(PriorityQueue* queue){
+	if(queue){
+		queue->size = 0;
+	}
+}
+
+int append_priority_queue(PriorityQueue* queue, size_t priority, void* item){
+	if(!queue){
+		return -1;
+	}
+	if(queue->size >= queue->capacity && grow_priority_queue(queue) != 0){
+		return -1;
+	}
+	queue->nodes[queue->size].priority = priority;
+	queue->nodes[queue->size].item = item;
+	queue->size++;
+	return 0;
+}
+
+void heapify_priority_queue(PriorityQueue* queue){
+	if(!queue || queue->size < 2){
+		return;
+	}
+	for(size_t i = queue->size / 2; i > 0; i--){
+		sift_down(queue, i - 1);
+	}
+}
+
+int push_priority_queue(PriorityQueue* queue, size_t priority, void* item){
+	if(append_priority_queue(queue, priority, item) != 0){
+		return -1;
+	}
+	sift_up(queue, queue->size - 1);
+	return 0;
+}
+
+bool peek_priority_queue(const PriorityQueue* queue, HeapNode* node){
+	if(!queue || queue->size == 0){
+		return false;
+	}
+	if(node){
+		*node = queue->nodes[0];
+	}
+	return true;
+}
+
+bool pop_priority_queue(PriorityQueue* queue, HeapNode* node){
+	if(!queue || queue->size == 0){
+		return false;
+	}
+	if(node){
+		*node = queue->nodes[0];
+	}
+	queue->size--;
+	if(queue->size > 0){
+		queue->nodes[0] = queue->nodes[queue->size];
+		sift_down(queue, 0);
+	}
+	return true;
+}
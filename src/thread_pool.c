@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread_pool.h>
+
+/*
+ * thread_pool.c
+ *
+ * Minimal pool for data parallel loops. A batch is a task function and a
+ * number of indices; workers take indices one at a time under the pool lock
+ * until the batch runs out. Tasks are expected to be coarse (a shard, a file)
+ * so the lock is not contended.
+ */
+
+// Takes indices of the current batch until none are left. Called and
+// returns with pool->lock held.
+static void run_pending_tasks(ThreadPool* pool){
+	while(pool->task != NULL && pool->next_task < pool->num_tasks){
+		size_t index = pool->next_task++;
+		ThreadPoolTask task = pool->task;
+		void* context = pool->context;
+
+		pthread_mutex_unlock(&pool->lock);
+		task(context, index);
+		pthread_mutex_lock(&pool->lock);
+
+		pool->tasks_done++;
+		if(pool->tasks_done == pool->num_tasks){
+			pthread_cond_broadcast(&pool->work_done);
+		}
+	}
+}
+
+static void* worker_main(void* arg){
+	ThreadPool* pool = (ThreadPool*)arg;
+	pthread_mutex_lock(&pool->lock);
+	while(!pool->shutdown){
+		if(pool->task == NULL || pool->next_task >= pool->num_tasks){
+			pthread_cond_wait(&pool->work_ready, &pool->lock);
+			continue;
+		}
+		run_pending_tasks(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+ThreadPool* create_thread_pool(size_t num_threads){
+	if(num_threads == 0){
+		num_threads = 1;
+	}
+	ThreadPool* pool = malloc(sizeof(ThreadPool));
+	if(!pool){
+		fprintf(stderr, "Error: Could not allocate thread pool.\n");
+		return NULL;
+	}
+	pool->threads = malloc(num_threads * sizeof(pthread_t));
+	if(!pool->threads){
+		fprintf(stderr, "Error: Could not allocate thread pool.\n");
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_ready, NULL);
+	pthread_cond_init(&pool->work_done, NULL);
+	pool->task = NULL;
+	pool->context = NULL;
+	pool->num_tasks = 0;
+	pool->next_task = 0;
+	pool->tasks_done = 0;
+	pool->shutdown = false;
+	pool->num_threads = 1;
+	pool->requested_threads = num_threads;
+
+	// Slot 0 stands for the calling thread.
+	for(size_t i = 1; i < num_threads; i++){
+		if(pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0){
+			fprintf(stderr, "Error: Could only start %zu of %zu threads.\n", i, num_threads);
+			break;
+		}
+		pool->num_threads++;
+	}
+	return pool;
+}
+
+void free_thread_pool(ThreadPool* pool){
+	if(!pool){
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->work_ready);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(size_t i = 1; i < pool->num_threads; i++){
+		pthread_join(pool->threads[i], NULL);
+	}
+	pthread_cond_destroy(&pool->work_done);
+	pthread_cond_destroy(&pool->work_ready);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool);
+}
+
+int run_thread_pool(ThreadPool* pool, size_t num_tasks, ThreadPoolTask task, void* context){
+	if(!pool || !task){
+		return -1;
+	}
+	if(num_tasks == 0){
+		return 0;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->task = task;
+	pool->context = context;
+	pool->num_tasks = num_tasks;
+	pool->next_task = 0;
+	pool->tasks_done = 0;
+	pthread_cond_broadcast(&pool->work_ready);
+
+	run_pending_tasks(pool);
+	while(pool->tasks_done < pool->num_tasks){
+		pthread_cond_wait(&pool->work_done, &pool->lock);
+	}
+	pool->task = NULL;
+	pool->context = NULL;
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
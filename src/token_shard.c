@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <token_shard.h>
+#include <config.h>
+
+/*
+ * token_shard.c
+ *
+ * Writes encoded documents to shard files and maps them back. Ids arrive
+ * from encode_stream() a chunk at a time and are narrowed to the shard dtype
+ * straight into the write buffer. The file is unbuffered, so each fwrite of
+ * the buffer is one write of SHARD_BUFFER_SIZE bytes at an aligned offset.
+ * The header goes in last, once the counts are known.
+ */
+
+static int flush_shard_buffer(ShardWriter* writer){
+	if(writer->buffer_used == 0){
+		return 0;
+	}
+	if(fwrite(writer->buffer, 1, writer->buffer_used, writer->file) != writer->buffer_used){
+		return -1;
+	}
+	writer->buffer_used = 0;
+	return 0;
+}
+
+static int start_shard(ShardWriter* writer){
+	size_t length = strlen(writer->path_prefix) + 32;
+	writer->tmp_path = malloc(length);
+	if(!writer->tmp_path){
+		return -1;
+	}
+	snprintf(writer->tmp_path, length, "%s_%05zu.bin.tmp", writer->path_prefix, writer->num_shards);
+	writer->file = fopen(writer->tmp_path, "wb");
+	if(!writer->file){
+		fprintf(stderr, "Error: Could not open shard %s for writing.\n", writer->tmp_path);
+		free(writer->tmp_path);
+		writer->tmp_path = NULL;
+		return -1;
+	}
+	setvbuf(writer->file, NULL, _IONBF, 0);
+	writer->num_shards++;
+	writer->num_tokens = 0;
+	writer->num_documents = 0;
+	// Room for the header, which is written when the shard is finished.
+	memset(writer->buffer, 0, SHARD_ALIGNMENT);
+	writer->buffer_used = SHARD_ALIGNMENT;
+	return 0;
+}
+
+// Drops the current shard after an error.
+static void abandon_shard(ShardWriter* writer){
+	if(writer->file){
+		fclose(writer->file);
+		remove(writer->tmp_path);
+	}
+	writer->file = NULL;
+	free(writer->tmp_path);
+	writer->tmp_path = NULL;
+}
+
+static int finish_shard(ShardWriter* writer){
+	ShardHeader header;
+	memset(&header, 0, sizeof(ShardHeader));
+	memcpy(header.magic, TOKEN_SHARD_MAGIC, 8);
+	header.dtype = writer->dtype;
+	header.vocab_size = writer->frozen->num_ids;
+	header.num_tokens = writer->num_tokens;
+	header.num_documents = writer->num_documents;
+	header.tokens_offset = SHARD_ALIGNMENT;
+
+	// Pad the ids to 8 bytes for the document index. Only full buffers are
+	// flushed and their size is a multiple of 8, so the buffer is never full
+	// when padding is needed.
+	size_t end = SHARD_ALIGNMENT + writer->num_tokens * writer->dtype;
+	size_t padding = (8 - end % 8) % 8;
+	memset(writer->buffer + writer->buffer_used, 0, padding);
+	writer->buffer_used += padding;
+	header.documents_offset = end + padding;
+
+	int result = 0;
+	writer->documents[writer->num_documents] = writer->num_tokens;
+	for(size_t d = 0; d <= writer->num_documents && result == 0; d++){
+		if(writer->buffer_used + sizeof(uint64_t) > SHARD_BUFFER_SIZE){
+			result = flush_shard_buffer(writer);
+		}
+		memcpy(writer->buffer + writer->buffer_used, &writer->documents[d], sizeof(uint64_t));
+		writer->buffer_used += sizeof(uint64_t);
+	}
+	if(result == 0) result = flush_shard_buffer(writer);
+	if(result == 0 && fseek(writer->file, 0, SEEK_SET) != 0) result = -1;
+	if(result == 0 && fwrite(&header, sizeof(ShardHeader), 1, writer->file) != 1) result = -1;
+	if(fclose(writer->file) != 0) result = -1;
+	writer->file = NULL;
+
+	// The final name is the tmp path without ".tmp".
+	char* path = strdup(writer->tmp_path);
+	if(!path) result = -1;
+	if(result == 0){
+		path[strlen(path) - 4] = '\0';
+		if(rename(writer->tmp_path, path) != 0) result = -1;
+	}
+	if(result != 0){
+		fprintf(stderr, "Error: Could not write shard %s.\n", writer->tmp_path);
+		remove(writer->tmp_path);
+	}
+	free(path);
+	free(writer->tmp_path);
+	writer->tmp_path = NULL;
+	return result;
+}
+
+ShardWriter* create_shard_writer(const FrozenTokenizer* frozen, const char* path_prefix, ShardDtype dtype, size_t max_tokens_per_shard){
+	if(frozen == NULL || path_prefix == NULL || (dtype != SHARD_DTYPE_UINT16 && dtype != SHARD_DTYPE_UINT32)){
+		return NULL;
+	}
+	if(dtype == SHARD_DTYPE_UINT16 && frozen->num_ids > UINT16_MAX + 1){
+		fprintf(stderr, "Error: %zu ids do not fit in uint16 shards.\n", frozen->num_ids);
+		return NULL;
+	}
+	ShardWriter* writer = calloc(1, sizeof(ShardWriter));
+	if(!writer){
+		fprintf(stderr, "Error: Could not allocate shard writer.\n");
+		return NULL;
+	}
+	writer->frozen = frozen;
+	writer->dtype = dtype;
+	writer->max_tokens_per_shard = max_tokens_per_shard;
+	writer->path_prefix = strdup(path_prefix);
+	writer->documents_capacity = 64;
+	writer->documents = malloc(writer->documents_capacity * sizeof(uint64_t));
+	if(posix_memalign((void**)&writer->buffer, SHARD_ALIGNMENT, SHARD_BUFFER_SIZE) != 0){
+		writer->buffer = NULL;
+	}
+	if(!writer->path_prefix || !writer->documents || !writer->buffer){
+		fprintf(stderr, "Error: Could not allocate shard writer.\n");
+		close_shard_writer(writer);
+		return NULL;
+	}
+	return writer;
+}
+
+static int write_ids(void* context, const uint32_t* ids, size_t num_ids){
+	ShardWriter* writer = (ShardWriter*)context;
+	while(num_ids > 0){
+		size_t room = (SHARD_BUFFER_SIZE - writer->buffer_used) / writer->dtype;
+		if(room == 0){
+			if(flush_shard_buffer(writer) != 0){
+				fprintf(stderr, "Error: Could not write shard %s.\n", writer->tmp_path);
+				return -1;
+			}
+			continue;
+		}
+		size_t count = num_ids < room ? num_ids : room;
+		unsigned char* out = writer->buffer + writer->buffer_used;
+		if(writer->dtype == SHARD_DTYPE_UINT16){
+			uint16_t* narrow = (uint16_t*)out;
+			for(size_t i = 0; i < count; i++){
+				narrow[i] = (uint16_t)ids[i];
+			}
+		}else{
+			memcpy(out, ids, count * sizeof(uint32_t));
+		}
+		writer->buffer_used += count * writer->dtype;
+		writer->num_tokens += count;
+		ids += count;
+		num_ids -= count;
+	}
+	return 0;
+}
+
+int shard_writer_add_file(ShardWriter* writer, TextFile* file){
+	if(writer == NULL || file == NULL){
+		return -1;
+	}
+	if(writer->file == NULL && start_shard(writer) != 0){
+		return -1;
+	}
+	// One slot is kept free for the end of the last document.
+	if(writer->num_documents + 2 > writer->documents_capacity){
+		size_t capacity = writer->documents_capacity * 2;
+		uint64_t* documents = realloc(writer->documents, capacity * sizeof(uint64_t));
+		if(!documents){
+			fprintf(stderr, "Error: Could not grow the shard document index.\n");
+			return -1;
+		}
+		writer->documents = documents;
+		writer->documents_capacity = capacity;
+	}
+	writer->documents[writer->num_documents++] = writer->num_tokens;
+	if(encode_stream(writer->frozen, file, STREAM_CHUNK_SIZE, write_ids, writer) != 0){
+		abandon_shard(writer);
+		return -1;
+	}
+	if(writer->max_tokens_per_shard > 0 && writer->num_tokens >= writer->max_tokens_per_shard){
+		return finish_shard(writer);
+	}
+	return 0;
+}
+
+int close_shard_writer(ShardWriter* writer){
+	if(writer == NULL){
+		return -1;
+	}
+	int result = 0;
+	// Even an empty export leaves one shard behind.
+	if(writer->path_prefix && writer->buffer && writer->documents && writer->file == NULL && writer->num_shards == 0){
+		result = start_shard(writer);
+	}
+	if(writer->file){
+		result = finish_shard(writer);
+	}
+	free(writer->tmp_path);
+	free(writer->path_prefix);
+	free(writer->documents);
+	free(writer->buffer);
+	free(writer);
+	return result;
+}
+
+int export_file_shards(const FrozenTokenizer* frozen, TextFile* file, const char* path_prefix, ShardDtype dtype, size_t max_tokens_per_shard){
+	if(file == NULL){
+		return -1;
+	}
+	ShardWriter* writer = create_shard_writer(frozen, path_prefix, dtype, max_tokens_per_shard);
+	if(!writer){
+		return -1;
+	}
+	int result = shard_writer_add_file(writer, file);
+	size_t num_shards = writer->num_shards;
+	if(close_shard_writer(writer) != 0) result = -1;
+	return result == 0 ? (int)num_shards : -1;
+}
+
+int export_dataset_shards(const FrozenTokenizer* frozen, Dataset* dataset, const char* path_prefix, ShardDtype dtype, size_t max_tokens_per_shard){
+	if(dataset == NULL){
+		return -1;
+	}
+	ShardWriter* writer = create_shard_writer(frozen, path_prefix, dtype, max_tokens_per_shard);
+	if(!writer){
+		return -1;
+	}
+	int result = 0;
+	for(size_t c = 0; c < dataset->num_categories && result == 0; c++){
+		Category* category = dataset->categories[c];
+		for(size_t f = 0; f < category->num_files && result == 0; f++){
+			result = shard_writer_add_file(writer, category->files[f]);
+		}
+	}
+	size_t num_shards = writer->num_shards;
+	if(close_shard_writer(writer) != 0) result = -1;
+	return result == 0 ? (int)num_shards : -1;
+}
+
+TokenShard* open_token_shard(const char* path){
+	if(path == NULL){
+		return NULL;
+	}
+	int fd = open(path, O_RDONLY);
+	if(fd < 0){
+		fprintf(stderr, "Error: Could not open shard %s.\n", path);
+		return NULL;
+	}
+	struct stat info;
+	if(fstat(fd, &info) != 0 || (size_t)info.st_size < SHARD_ALIGNMENT){
+		fprintf(stderr, "Error: %s is not a token shard.\n", path);
+		close(fd);
+		return NULL;
+	}
+	void* map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED){
+		fprintf(stderr, "Error: Could not map shard %s.\n", path);
+		return NULL;
+	}
+	TokenShard* shard = malloc(sizeof(TokenShard));
+	if(!shard){
+		munmap(map, (size_t)info.st_size);
+		return NULL;
+	}
+	shard->map = map;
+	shard->map_size = (size_t)info.st_size;
+	shard->header = (const ShardHeader*)map;
+
+	// Every section has to lie inside the file.
+	const ShardHeader* header = shard->header;
+	bool valid = memcmp(header->magic, TOKEN_SHARD_MAGIC, 8) == 0 &&
+		(header->dtype == SHARD_DTYPE_UINT16 || header->dtype == SHARD_DTYPE_UINT32) &&
+		header->tokens_offset == SHARD_ALIGNMENT &&
+		header->num_tokens <= (shard->map_size - header->tokens_offset) / header->dtype &&
+		header->documents_offset % 8 == 0 &&
+		header->documents_offset >= header->tokens_offset + header->num_tokens * header->dtype &&
+		header->documents_offset <= shard->map_size &&
+		header->num_documents < (shard->map_size - header->documents_offset) / sizeof(uint64_t);
+	if(!valid){
+		fprintf(stderr, "Error: %s is not a token shard.\n", path);
+		close_token_shard(shard);
+		return NULL;
+	}
+	shard->tokens = (const char*)map + header->tokens_offset;
+	shard->documents = (const uint64_t*)((const char*)map + header->documents_offset);
+	return shard;
+}
+
+void close_token_shard(TokenShard* shard){
+	if(!shard){
+		return;
+	}
+	munmap(shard->map, shard->map_size);
+	free(shard);
+}
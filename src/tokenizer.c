@@ -2,12 +2,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 #include <tokenizer.h>
 #include <utils.h>
 #include <hash_table.h>
 #include <config.h>
 #include <debug.h>
 #include <dataset.h>
+#include <priority_queue.h>
+#include <thread_pool.h>
+#include <utf8.h>
+#include <pretokenizer.h>
 
 /*
  * tokenizer.c
@@ -41,6 +46,8 @@
  * - Character mode: splits into individual chars (empty delimiter)
  * - Delimiter mode: splits on specified delimiters
  * Adds '_' separator between tokens
+ * tokenize_with_mode() with PRETOKENIZE_GPT2 splits into GPT-2 pre-tokens
+ * instead of words; delimiters then only selects character mode.
  */
 #define CLEANUP() {  \
 	if (text) { \
@@ -53,13 +60,18 @@
 	}\
        	free(*line); \
         free(line); \
-	free(copy); \
 	for (size_t j = 0; j < count; j++) {\
 		free_token(tokens[j]);\
 	}\
 	free(tokens);\
 }
 
+// Tie-break for pair_queue: pairs with equal counts pop in key order, which is
+// the same order find_most_freq_pairs uses.
+static int compare_pair_entries(const void* a, const void* b){
+	return uint64_compare(((const HashEntry*)a)->key, ((const HashEntry*)b)->key);
+}
+
 //TODO: Centralize the logic for resizing a tokenizer's vocabulary.
 //	Functions to consider changing are resize_vocabulary, resize_hash_table, resize_dataset
 //
@@ -81,21 +93,46 @@ Tokenizer* create_tokenizer(size_t max_vocab_size) {
     tokenizer->max_vocab_size = max_vocab_size;
     tokenizer->pair_freqs = create_hash_table(INITIAL_PAIR_FREQ_SIZE);
     tokenizer->token_map = create_hash_table(max_vocab_size);
-    if (!tokenizer->pair_freqs || !tokenizer->token_map) {
+    tokenizer->pair_queue = create_priority_queue(INITIAL_PAIR_FREQ_SIZE, compare_pair_entries);
+    if (!tokenizer->pair_freqs || !tokenizer->token_map || !tokenizer->pair_queue) {
     	// Clean up and return NULL
    	if (tokenizer->pair_freqs) free_hash_table(tokenizer->pair_freqs);
    	if (tokenizer->token_map) free_hash_table(tokenizer->token_map);
+   	if (tokenizer->pair_queue) free_priority_queue(tokenizer->pair_queue);
     	free(tokenizer->vocabulary);
     	free(tokenizer);
     	return NULL;
     }
     DEBUG_TOK("\n");
     tokenizer->token_map->allow_resize = false;
+    create_uint64_ops(tokenizer->pair_freqs);
+    tokenizer->pair_freqs->ops.free_value = free_pair_stats;
+    tokenizer->incremental_pairs = true;
+    tokenizer->deduplicate_words = true;
+    tokenizer->merges = NULL;
+    tokenizer->num_merges = 0;
+    tokenizer->merges_capacity = 0;
+    tokenizer->num_threads = 1;
+    tokenizer->thread_pool = NULL;
+    tokenizer->stream_chunk_size = STREAM_CHUNK_SIZE;
+    tokenizer->max_words_in_memory = MAX_WORDS_IN_MEMORY;
+    tokenizer->merges_per_pass = 1;
+    tokenizer->byte_level = false;
+    tokenizer->pretokenizer = PRETOKENIZE_SPACES;
+    tokenizer->checkpoint_path = NULL;
+    tokenizer->checkpoint_every = 0;
+    tokenizer->checkpoint_interval = 0;
     return tokenizer;
 }
 
 // Add a token to the vocabulary
 void add_to_vocabulary(Tokenizer* tokenizer, const char* token) {
+	add_to_vocabulary_with_frequency(tokenizer, token, 1);
+}
+
+// Add a token seen frequency times, e.g. a character of a word that occurs
+// frequency times in the corpus.
+void add_to_vocabulary_with_frequency(Tokenizer* tokenizer, const char* token, size_t frequency) {
 	// Sanity check
 	if(tokenizer ==NULL || token == NULL){
 		DEBUG_VOC("Invalid tokenizer or tokens\n");
@@ -125,7 +162,7 @@ void add_to_vocabulary(Tokenizer* tokenizer, const char* token) {
         		DEBUG_VOC("Token %s already in the vocabulary. Frequency: %zu.\n",
             		tokenizer->vocabulary[index]->text, 
             		tokenizer->vocabulary[index]->frequency);
-        		tokenizer->vocabulary[index]->frequency++;
+        		tokenizer->vocabulary[index]->frequency += frequency;
         		free_iterator(it);
         		return;
     		}
@@ -136,7 +173,7 @@ void add_to_vocabulary(Tokenizer* tokenizer, const char* token) {
         DEBUG_MEM("Error allocating memory for new token\n");
         return;  // Handle memory allocation failure for token
     }
-	new_token->frequency = 1;
+	new_token->frequency = frequency;
 	DEBUG_VOC("New Token created Text: %s Frequency: %zu.\n",new_token->text, new_token->frequency);
     // Expand the vocabulary if needed
 
@@ -146,6 +183,7 @@ void add_to_vocabulary(Tokenizer* tokenizer, const char* token) {
 	}
     } else if (tokenizer->vocab_size >= tokenizer->max_vocab_size) {
 	    DEBUG_VOC("Error: Vocabulary at maximum capacity\n");
+	    free_token(new_token);
 	    return;
     }
 
@@ -190,43 +228,43 @@ int insert_into_token_map(HashTable* table, const char* key, size_t value){
 		return -1;
 	}
 	size_t v = value;
-	HashEntry* entry = create_hash_entry((const void*)key, strlen(key) + 1, (const void*)&v, sizeof(size_t));
-	if(entry == NULL){
-		DEBUG_MEM("Error: Could not allocate enough memory for hash entry\n");
-		return -1;
-	}
 
 	// Check to see if the key is already in the token_map. If so, update its value.
 	HashTableIterator* it  = create_iterator(table);
 	if(!it){
 		DEBUG_VOC("Error: Could not create a HashTableIterator.\n");
-		table->ops.free_key(entry->key);
-		table->ops.free_value(entry->value);
-		free(entry);
 		return -1;
 	}
 
 	while(has_next(it)){
 		HashEntry* entry1 = get_next(it);
 		if(!entry1){
-			//DEBUG_HASH("Error from get_next from insert_to_token_map.\n");
-			//table->ops.free_key(entry->key);
-                	//table->ops.free_value(entry->value);
-                	//free(entry);
-			//free_iterator(it);
 			break;//  NULL from get_next indicate error not empty slots.
 		}
 		if(table->ops.compare_keys((const void*)entry1->key, (const void*)key) == 0){
 			table->ops.free_value(table->entries[it->current_index]->value);
 			table->entries[it->current_index]->value = table->ops.duplicate_value((const void*)&v);
-			table->ops.free_key(entry->key);
-                	table->ops.free_value(entry->value);
-			free(entry);
 			free_iterator(it);
 			return 0;
 		}
 	}
 	free_iterator(it);	
+	return append_to_token_map(table, key, value);
+}
+
+// Appends key without looking for an existing entry. Only for keys known to
+// be new, such as the byte alphabet of a fresh tokenizer.
+int append_to_token_map(HashTable* table, const char* key, size_t value){
+	if(table == NULL || key == NULL){
+		DEBUG_VOC("Error: Invalid hash table or key\n");
+		return -1;
+	}
+	size_t v = value;
+	HashEntry* entry = create_hash_entry((const void*)key, strlen(key) + 1, (const void*)&v, sizeof(size_t));
+	if(entry == NULL){
+		DEBUG_MEM("Error: Could not allocate enough memory for hash entry\n");
+		return -1;
+	}
 
 	// Ensure the table has enough capacity
     if (table->size >= table->capacity) {
@@ -234,7 +272,6 @@ int insert_into_token_map(HashTable* table, const char* key, size_t value){
 	    	table->ops.free_key(entry->key);
 	    	table->ops.free_value(entry->value);
             	free(entry);
-		free_iterator(it);
 		return -1;
 	    }
         size_t new_capacity = table->capacity * 2;
@@ -244,7 +281,6 @@ int insert_into_token_map(HashTable* table, const char* key, size_t value){
 	    table->ops.free_key(entry->key);
                 table->ops.free_value(entry->value);
                 free(entry);
-                free_iterator(it);
             return -1;
         }
         // Initialize new slots to NULL
@@ -285,6 +321,10 @@ int add_token(Token** tokens, size_t* count, size_t* capacity, Token* token) {
 // Tokenize input text:wq
 //
 Token** tokenize(TextFile* file, const char* delimiters, size_t* num_tokens) {
+	return tokenize_with_mode(file, delimiters, PRETOKENIZE_SPACES, num_tokens);
+}
+
+Token** tokenize_with_mode(TextFile* file, const char* delimiters, PretokenizerMode mode, size_t* num_tokens) {
 	// Sanity checks
        	if (delimiters == NULL || file == NULL) { return NULL; }
        	size_t count = 0; 
@@ -316,25 +356,28 @@ Token** tokenize(TextFile* file, const char* delimiters, size_t* num_tokens) {
 			return NULL;
 	}
 	bool has_content = false;
+	size_t invalid_sequences = 0;
+	// Character mode splits words on spaces, then words into characters.
+	bool character_level = strlen(delimiters) == 0;
+	DelimiterSet delimiter_set;
+	make_delimiter_set(&delimiter_set, character_level ? " " : delimiters);
 	while ((res = read_line(file,line)) == 0) { 
 		//char* line = dataset->lines[i]; 
 		if (line == NULL || strlen(*line) == 0) {continue; } // skip empty lines 
 		has_content = true;
-		char* copy = strdup(*line); 
-		if (copy == NULL) { 
-			fprintf(stderr, "Error: Failed to duplicate line\n"); 
-			CLEANUP(); 
-			return NULL; 
-		}
-
-
-		char* token;
-		if (strlen(delimiters) == 0) { 
-			// Character-level tokenization 
-			token = strtok(copy, " "); 
-			while (token != NULL) { 
+		// Words are cut in place: the byte after a word is swapped for a
+		// terminator while the word is used, then put back.
+		size_t line_length = strlen(*line);
+		Pretokenizer pretokenizer;
+		init_pretokenizer(&pretokenizer, mode, &delimiter_set, *line, line_length);
+		WordSpan span;
+		while (next_pretoken(&pretokenizer, &span)) {
+			char* word = *line + span.offset;
+			char after = word[span.length];
+			word[span.length] = '\0';
+			if (character_level) {
 				step = 0; 
-				text = split_by_character((const char*)token); 
+				text = split_utf8_characters((const char*)word, &invalid_sequences); 
 				if (text == NULL) { 
 					fprintf(stderr, "Error: Failed to split token into characters\n"); 
 					CLEANUP(); 
@@ -368,30 +411,8 @@ Token** tokenize(TextFile* file, const char* delimiters, size_t* num_tokens) {
 				} 
 				free(text); 
 				text = NULL; 
-				Token* separator = create_token("\x1f"); 
-				if (separator == NULL) { 
-					fprintf(stderr, "Error: Failed to create separator token\n"); 
-					CLEANUP(); 
-					return NULL; 
-				} 
-				if (count >= capacity) { 
-					capacity *= 2; 
-					Token** tmp_tokens = (Token**)realloc(tokens, sizeof(Token*) * capacity); 
-					if (tmp_tokens == NULL) 
-					{ 
-						fprintf(stderr, "Error: Failed to reallocate memory for tokens\n"); 
-						free_token(separator); CLEANUP(); return NULL; 
-					} 
-					tokens = tmp_tokens; 
-				} 
-				tokens[count++] = separator; 
-				token = strtok(NULL, " "); 
-			} 
-		} else { 
-			// Normal delimiter-based tokenization 
-			token = strtok(copy, delimiters); 
-			while (token != NULL) { 
-				Token* tok = create_token(token); 
+			} else { 
+				Token* tok = create_token(word); 
 				if (tok == NULL) { 
 					fprintf(stderr, "Error: Failed to create token\n"); 
 					CLEANUP(); 
@@ -407,27 +428,26 @@ Token** tokenize(TextFile* file, const char* delimiters, size_t* num_tokens) {
 					tokens = tmp_tokens; 
 				} 
 				tokens[count++] = tok; 
-				Token* separator = create_token("\x1f"); 
-				if (separator == NULL) { 
-					fprintf(stderr, "Error: Failed to create separator token\n"); 
+			}
+			word[span.length] = after;
+			Token* separator = create_token("\x1f"); 
+			if (separator == NULL) { 
+				fprintf(stderr, "Error: Failed to create separator token\n"); 
+				CLEANUP(); 
+				return NULL; 
+			} 
+			if (count >= capacity) { 
+				capacity *= 2; 
+				Token** tmp_tokens = (Token**)realloc(tokens, sizeof(Token*) * capacity); 
+				if (tmp_tokens == NULL) { 
+					fprintf(stderr, "Error: Failed to reallocate memory for tokens\n"); 
+					free_token(separator); 
 					CLEANUP(); 
 					return NULL; 
-				} 
-				if (count >= capacity) { 
-					capacity *= 2; 
-					Token** tmp_tokens = (Token**)realloc(tokens, sizeof(Token*) * capacity); 
-					if (tmp_tokens == NULL) { 
-						fprintf(stderr, "Error: Failed to reallocate memory for tokens\n"); 
-						free_token(separator); 
-						CLEANUP(); 
-						return NULL; 
-					} tokens = tmp_tokens; 
-				} 
-				tokens[count++] = separator; 
-				token = strtok(NULL, delimiters); 
+				} tokens = tmp_tokens; 
 			} 
+			tokens[count++] = separator; 
 		}
-		free(copy);
 		free(*line);
 	}
 	if(!has_content){
@@ -440,6 +460,9 @@ Token** tokenize(TextFile* file, const char* delimiters, size_t* num_tokens) {
 		fprintf(stderr,"Error while reading line in the textfile.\n");
 	}else if(res == -2){
 	}
+	if(invalid_sequences > 0){
+		fprintf(stderr, "Warning: %zu invalid UTF-8 sequences in %s kept as single bytes\n", invalid_sequences, file->filepath);
+	}
 	tokens[count] = NULL; 
 	*num_tokens = count;
 	free(*line);
@@ -452,7 +475,17 @@ Token** tokenize(TextFile* file, const char* delimiters, size_t* num_tokens) {
 
 
 char** split_by_character(const char* input){
-	if(strlen(input) == 0 || input == NULL){
+	return split_utf8_characters(input, NULL);
+}
+
+/*
+ * Splits input into UTF-8 characters, so a multi-byte code point becomes one
+ * token instead of one token per byte. Bytes that do not start a valid
+ * sequence are kept as single-byte tokens and counted in invalid when it is
+ * not NULL. ASCII runs are found with utf8_ascii_run.
+ */
+char** split_utf8_characters(const char* input, size_t* invalid){
+	if(input == NULL || strlen(input) == 0){
 		return NULL;
 	}
 	size_t length = strlen(input);
@@ -463,24 +496,38 @@ char** split_by_character(const char* input){
 		return NULL;
 	}
 
-	for(size_t i = 0;i < length;i++){
-		char* character = (char*)malloc(2);
+	size_t count = 0;
+	size_t ascii_end = 0;
+	for(size_t i = 0; i < length; ){
+		if(i >= ascii_end){
+			ascii_end = i + utf8_ascii_run(input + i, length - i);
+		}
+		size_t char_length = 1;
+		if(i >= ascii_end){
+			char_length = utf8_char_length(input + i, length - i);
+			if(char_length == 0){
+				if(invalid) (*invalid)++;
+				char_length = 1;
+			}
+		}
+		char* character = (char*)malloc(char_length + 1);
 		if (!character) {
             fprintf(stderr, "Error: Failed to allocate memory for character token\n");
 
             // Free already allocated memory before returning NULL
-            	for (size_t	j = 0; j < i; j++) {
+            	for (size_t	j = 0; j < count; j++) {
                 	free(text[j]);
             	}
             	free(text);
             	return NULL;
         	}
-		character[0] = input[i];
-		character[1] = '\0';
-		text[i] = character;
+		memcpy(character, input + i, char_length);
+		character[char_length] = '\0';
+		text[count++] = character;
+		i += char_length;
 	}
 
-	text[length] = NULL;
+	text[count] = NULL;
 	return text;
 }
 
@@ -512,6 +559,14 @@ void free_tokenizer(Tokenizer** tokenizer) {
 	(*tokenizer)->pair_freqs = NULL;
 	free_hash_table((*tokenizer)->token_map);
     	(*tokenizer)->token_map = NULL;
+	free_priority_queue((*tokenizer)->pair_queue);
+	(*tokenizer)->pair_queue = NULL;
+	free((*tokenizer)->merges);
+	(*tokenizer)->merges = NULL;
+	free_thread_pool((*tokenizer)->thread_pool);
+	(*tokenizer)->thread_pool = NULL;
+	free((*tokenizer)->checkpoint_path);
+	(*tokenizer)->checkpoint_path = NULL;
 	DEBUG_MEM("Freeing the Vocabulary itself %p\n", (void*)(*tokenizer)->vocabulary);
     free((*tokenizer)->vocabulary);
     (*tokenizer)->vocabulary = NULL;
@@ -527,7 +582,7 @@ void initialize_vocabulary(Tokenizer* tokenizer,TextFile* file){
 
 	size_t num_tokens = 0;
 
-	Token** tokens = tokenize(file,"",&num_tokens);
+	Token** tokens = tokenize_with_mode(file,"",tokenizer->pretokenizer,&num_tokens);
 	if(tokens == NULL){
 		fprintf(stderr, "Error: the dataset could not be tokenize at character level\n");
 		return;
@@ -548,81 +603,420 @@ void initialize_vocabulary(Tokenizer* tokenizer,TextFile* file){
 	free(tokens);
 }
 
+// A token can take part in a pair only if all of its characters are
+// printable ASCII or well formed multi-byte UTF-8; this keeps the word
+// separator, control characters and invalid bytes out of every merge.
+static bool token_is_pairable(const char* text){
+	size_t length = strlen(text);
+	for(size_t i = 0; i < length; ){
+		unsigned char c = (unsigned char)text[i];
+		if(c < 0x80){
+			if(!isprint(c)) return false;
+			i++;
+			continue;
+		}
+		size_t char_length = utf8_char_length(text + i, length - i);
+		if(char_length == 0) return false;
+		i += char_length;
+	}
+	return true;
+}
+
 bool validate_pairs(const char* current, const char* next){
-	for(size_t i = 0; i < strlen(current); i++){
-		if(!isprint(current[i])) return false;
+	return token_is_pairable(current) && token_is_pairable(next);
+}
+
+void count_pairs(Tokenizer* tokenizer, const TokenSequence* sequence){
+	if (tokenizer == NULL || sequence == NULL || tokenizer->pair_freqs == NULL) {
+		fprintf(stderr, "Error: Tokenizer or hash tables not initialized\n");
+		return;
+	}
+	if(tokenizer->byte_level && tokenizer->num_merges == 0 && count_byte_pairs(tokenizer, sequence) == 0){
+		return; // first round: only byte ids yet
+	}
+	if(tokenizer->num_threads > 1 && sequence->size >= 2 * MIN_SLOTS_PER_SHARD){
+		size_t num_shards = sequence->size / MIN_SLOTS_PER_SHARD;
+		if(num_shards > tokenizer->num_threads) num_shards = tokenizer->num_threads;
+		if(count_pairs_parallel(tokenizer, sequence, num_shards) == 0){
+			return;
+		}
+		DEBUG_TOK("Parallel pair count failed, counting serially\n");
 	}
+	reset_hash_table(tokenizer->pair_freqs); // Clear existing frequencies
 
-	for(size_t i = 0; i < strlen(next); i++){
-		if(!isprint(next[i])) return false;
+	for(size_t i = 0; i < sequence->size; i++){
+		size_t next = sequence->next[i];
+		if(next == NO_POSITION){
+			continue; // hole, end of a word or end of the sequence
+		}
+		// Only the incremental path uses the position index.
+		size_t position = tokenizer->incremental_pairs ? i : NO_POSITION;
+		update_pair_frequency(tokenizer->pair_freqs, NULL, sequence->ids[i], sequence->ids[next], (int64_t)sequence->weights[i], position);
 	}
+}
 
-	return true;
+ThreadPool* get_thread_pool(Tokenizer* tokenizer){
+	if(tokenizer == NULL){
+		return NULL;
+	}
+	size_t wanted = tokenizer->num_threads ? tokenizer->num_threads : 1;
+	// A pool that started fewer threads than asked for is kept: creating it
+	// again would most likely fail the same way.
+	if(tokenizer->thread_pool && tokenizer->thread_pool->requested_threads != wanted){
+		free_thread_pool(tokenizer->thread_pool);
+		tokenizer->thread_pool = NULL;
+	}
+	if(tokenizer->thread_pool == NULL){
+		tokenizer->thread_pool = create_thread_pool(wanted);
+	}
+	return tokenizer->thread_pool;
 }
-void count_pairs(Tokenizer* tokenizer, Token** tokens, size_t num_tokens){
-	 if (tokenizer == NULL || tokens == NULL || tokenizer->pair_freqs == NULL) {
-        	fprintf(stderr, "Error: Tokenizer or hash tables not initialized\n");
-        	return;
-    	}
-	 reset_hash_table(tokenizer->pair_freqs); // Clear existing frequencies
-
-	for(size_t i = 0; i < num_tokens - 1;i++){
-		Token* current = tokens[i];
-		Token* next = tokens[i + 1];
-		if(current == NULL || next == NULL || !validate_pairs(current->text,next->text)){
+
+typedef struct {
+	const TokenSequence* sequence;
+	HashTable** tables;       // One pair table per shard
+	size_t num_shards;
+	bool record_positions;
+} PairCountJob;
+
+// Counts the pairs whose left slot lies in the shard. The right slot may sit
+// in the next shard; reading it is safe since the sequence is not modified,
+// and every pair is still counted exactly once.
+static void count_pairs_shard(void* context, size_t shard){
+	PairCountJob* job = (PairCountJob*)context;
+	const TokenSequence* sequence = job->sequence;
+	size_t start = sequence->size * shard / job->num_shards;
+	size_t end = sequence->size * (shard + 1) / job->num_shards;
+
+	for(size_t i = start; i < end; i++){
+		size_t next = sequence->next[i];
+		if(next == NO_POSITION){
 			continue;
 		}
+		size_t position = job->record_positions ? i : NO_POSITION;
+		update_pair_frequency(job->tables[shard], NULL, sequence->ids[i], sequence->ids[next], (int64_t)sequence->weights[i], position);
+	}
+}
 
-		// Debug statements to trace the loop
-        DEBUG_TOK("Processing tokens: %zu and %zu\n", i, i + 1);
-        if (current) {
-            DEBUG_TOK("Current token: %s\n", current->text);
-        }
-        if (next) {
-            DEBUG_TOK("Next token: %s\n", next->text);
-        }
-		char* pair_key = create_pair_key(current->text,next->text);
-		if (pair_key == NULL) {
-            		fprintf(stderr, "Error: Failed to create pair key\n");
+// Adds the counts and positions of from into into. Positions are appended,
+// so reducing shards in order keeps them sorted like a serial count does.
+static int merge_pair_stats(PairStats* into, const PairStats* from){
+	into->frequency += from->frequency;
+	if(from->num_positions == 0){
+		return 0;
+	}
+	size_t needed = into->num_positions + from->num_positions;
+	if(needed > into->positions_capacity){
+		size_t* positions = realloc(into->positions, needed * sizeof(size_t));
+		if(!positions){
+			return -1;
+		}
+		into->positions = positions;
+		into->positions_capacity = needed;
+	}
+	memcpy(into->positions + into->num_positions, from->positions, from->num_positions * sizeof(size_t));
+	into->num_positions = needed;
+	return 0;
+}
+
+/*
+ * Parallel version of count_pairs. The sequence is cut into num_shards
+ * contiguous ranges, each counted into its own table on the tokenizer's
+ * thread pool, and the tables are then reduced into pair_freqs in shard
+ * order. The result is identical to the serial count.
+ */
+int count_pairs_parallel(Tokenizer* tokenizer, const TokenSequence* sequence, size_t num_shards){
+	if (tokenizer == NULL || sequence == NULL || tokenizer->pair_freqs == NULL || num_shards == 0) {
+		return -1;
+	}
+	ThreadPool* pool = get_thread_pool(tokenizer);
+	if(pool == NULL){
+		return -1;
+	}
+	HashTable** tables = calloc(num_shards, sizeof(HashTable*));
+	if(!tables){
+		return -1;
+	}
+	int result = 0;
+	for(size_t s = 0; s < num_shards; s++){
+		tables[s] = create_hash_table(INITIAL_PAIR_FREQ_SIZE);
+		if(!tables[s]){
+			result = -1;
+			break;
+		}
+		create_uint64_ops(tables[s]);
+		tables[s]->ops.free_value = free_pair_stats;
+	}
+
+	if(result == 0){
+		PairCountJob job = {
+			.sequence = sequence,
+			.tables = tables,
+			.num_shards = num_shards,
+			.record_positions = tokenizer->incremental_pairs
+		};
+		result = run_thread_pool(pool, num_shards, count_pairs_shard, &job);
+	}
+
+	if(result == 0){
+		reset_hash_table(tokenizer->pair_freqs);
+		for(size_t s = 0; s < num_shards && result == 0; s++){
+			HashTable* table = tables[s];
+			for(size_t i = 0; i < table->capacity; i++){
+				HashEntry* entry = table->entries[i];
+				if(!entry || !entry->is_occupied){
+					continue;
+				}
+				PairStats* stats = (PairStats*)entry->value;
+				HashEntry* target = find_hash_entry(tokenizer->pair_freqs, entry->key);
+				if(target == NULL){
+					// The table copies the stats, so hand the position list over.
+					if(insert_into_hash_table(tokenizer->pair_freqs, entry->key, stats, sizeof(uint64_t), sizeof(PairStats)) != 0){
+						result = -1;
+						break;
+					}
+					stats->positions = NULL;
+					stats->num_positions = 0;
+					stats->positions_capacity = 0;
+				}else if(merge_pair_stats((PairStats*)target->value, stats) != 0){
+					result = -1;
+					break;
+				}
+			}
+		}
+	}
+
+	for(size_t s = 0; s < num_shards; s++){
+		free_hash_table(tables[s]);
+	}
+	free(tables);
+	return result;
+}
+
+#define BYTE_PAIR_COUNT (BYTE_ALPHABET_SIZE * BYTE_ALPHABET_SIZE)
+
+typedef struct {
+	const TokenSequence* sequence;
+	size_t num_shards;
+	size_t* frequencies;      // BYTE_PAIR_COUNT weighted counts per shard
+	size_t* occurrences;      // BYTE_PAIR_COUNT site counts per shard
+	bool* failed;             // Set by a shard that meets an id above 255
+} BytePairJob;
+
+static void count_byte_pairs_shard(void* context, size_t shard){
+	BytePairJob* job = (BytePairJob*)context;
+	const TokenSequence* sequence = job->sequence;
+	size_t* frequencies = job->frequencies + shard * BYTE_PAIR_COUNT;
+	size_t* occurrences = job->occurrences + shard * BYTE_PAIR_COUNT;
+	size_t start = sequence->size * shard / job->num_shards;
+	size_t end = sequence->size * (shard + 1) / job->num_shards;
+
+	for(size_t i = start; i < end; i++){
+		size_t next = sequence->next[i];
+		if(next == NO_POSITION){
+			continue;
+		}
+		uint32_t left = sequence->ids[i], right = sequence->ids[next];
+		if((left | right) >= BYTE_ALPHABET_SIZE){
+			job->failed[shard] = true;
 			return;
-        	}
+		}
+		size_t pair = left << 8 | right;
+		frequencies[pair] += sequence->weights[i];
+		occurrences[pair]++;
+	}
+}
 
-        	// Update the pair frequency
-		size_t freq1;
-        	int frequency = get_value(tokenizer->pair_freqs, pair_key, &freq1);
-        	if (frequency == 0) {
-			DEBUG_TOK("Incrementing frequency of freq pair %s.\n", pair_key);
-            		//insert_into_hash_table(tokenizer->pair_freqs, pair_key, frequency + 1);
-			increment_frequency_hash_table(tokenizer->pair_freqs, pair_key);
-        	}else{
-			size_t freq = 1;
-			DEBUG_TOK("Inserting freq pair %s into the hash table if you see this multiple time for the same token then get_value did not work as expected.\n",pair_key);
-            		insert_into_hash_table(tokenizer->pair_freqs, (const void*)pair_key, (const void*)&freq,strlen(pair_key) + 1,sizeof(size_t));
-        	}
+/*
+ * First counting round of byte-level training. While every id is a byte,
+ * a pair fits in 16 bits, so the pairs are counted into a dense
+ * 65536-entry array instead of being hashed one site at a time. Shards are
+ * counted on the thread pool when num_threads > 1. pair_freqs is then filled
+ * with one insert per distinct pair. Position lists get their exact size
+ * from the site counts and are filled in a second, in-order scan, so they
+ * come out sorted as with count_pairs. Returns -1 if the sequence holds an
+ * id above 255, in which case the caller counts through the hash table.
+ */
+int count_byte_pairs(Tokenizer* tokenizer, const TokenSequence* sequence){
+	if(tokenizer == NULL || sequence == NULL || tokenizer->pair_freqs == NULL){
+		return -1;
+	}
+	size_t num_shards = 1;
+	if(tokenizer->num_threads > 1 && sequence->size >= 2 * MIN_SLOTS_PER_SHARD){
+		num_shards = sequence->size / MIN_SLOTS_PER_SHARD;
+		if(num_shards > tokenizer->num_threads) num_shards = tokenizer->num_threads;
+	}
+	BytePairJob job = {
+		.sequence = sequence,
+		.num_shards = num_shards,
+		.frequencies = calloc(num_shards * BYTE_PAIR_COUNT, sizeof(size_t)),
+		.occurrences = calloc(num_shards * BYTE_PAIR_COUNT, sizeof(size_t)),
+		.failed = calloc(num_shards, sizeof(bool))
+	};
+	PairStats** stats = calloc(BYTE_PAIR_COUNT, sizeof(PairStats*));
+	ThreadPool* pool = num_shards > 1 ? get_thread_pool(tokenizer) : NULL;
+	int result = 0;
+	if(!job.frequencies || !job.occurrences || !job.failed || !stats || (num_shards > 1 && !pool)){
+		result = -1;
+	}else if(pool){
+		result = run_thread_pool(pool, num_shards, count_byte_pairs_shard, &job);
+	}else{
+		count_byte_pairs_shard(&job, 0);
+	}
+	for(size_t s = 0; s < num_shards && result == 0; s++){
+		if(job.failed[s]) result = -1;
+	}
+	// Fold the shards into the first one.
+	for(size_t s = 1; s < num_shards && result == 0; s++){
+		for(size_t pair = 0; pair < BYTE_PAIR_COUNT; pair++){
+			job.frequencies[pair] += job.frequencies[s * BYTE_PAIR_COUNT + pair];
+			job.occurrences[pair] += job.occurrences[s * BYTE_PAIR_COUNT + pair];
+		}
+	}
+
+	if(result == 0){
+		reset_hash_table(tokenizer->pair_freqs);
+		for(size_t pair = 0; pair < BYTE_PAIR_COUNT && result == 0; pair++){
+			if(job.occurrences[pair] == 0){
+				continue;
+			}
+			uint64_t key = create_pair_key((uint32_t)(pair >> 8), (uint32_t)(pair & 0xFF));
+			PairStats pair_stats = { .frequency = job.frequencies[pair] };
+			if(insert_into_hash_table(tokenizer->pair_freqs, &key, &pair_stats, sizeof(uint64_t), sizeof(PairStats)) != 0){
+				result = -1;
+				break;
+			}
+			stats[pair] = (PairStats*)find_hash_entry(tokenizer->pair_freqs, &key)->value;
+			if(tokenizer->incremental_pairs){
+				stats[pair]->positions = malloc(job.occurrences[pair] * sizeof(size_t));
+				if(!stats[pair]->positions){
+					result = -1;
+					break;
+				}
+				stats[pair]->positions_capacity = job.occurrences[pair];
+			}
+		}
+	}
+	if(result == 0 && tokenizer->incremental_pairs){
+		for(size_t i = 0; i < sequence->size; i++){
+			size_t next = sequence->next[i];
+			if(next == NO_POSITION){
+				continue;
+			}
+			PairStats* pair_stats = stats[sequence->ids[i] << 8 | sequence->ids[next]];
+			pair_stats->positions[pair_stats->num_positions++] = i;
+		}
+	}
+	if(result != 0){
+		reset_hash_table(tokenizer->pair_freqs);
+	}
+	free(job.frequencies);
+	free(job.occurrences);
+	free(job.failed);
+	free(stats);
+	return result;
+}
 
-        	free(pair_key);
+void free_pair_stats(void* value){
+	PairStats* stats = (PairStats*)value;
+	if(stats){
+		free(stats->positions);
+		free(stats);
 	}
 }
 
-char* create_pair_key(const char* token1, const char* token2) {
-    if (token1 == NULL || token2 == NULL) {
-        fprintf(stderr, "Error: NULL token provided for pair key creation\n");
-        return NULL;
-    }
+static int add_pair_position(PairStats* stats, size_t position){
+	if(stats->num_positions >= stats->positions_capacity){
+		size_t new_capacity = stats->positions_capacity ? stats->positions_capacity * 2 : 4;
+		size_t* positions = realloc(stats->positions, new_capacity * sizeof(size_t));
+		if(!positions){
+			DEBUG_MEM("Error: Could not grow pair position list to %zu\n", new_capacity);
+			return -1;
+		}
+		stats->positions = positions;
+		stats->positions_capacity = new_capacity;
+	}
+	stats->positions[stats->num_positions++] = position;
+	return 0;
+}
 
-    size_t len1 = strlen(token1); // Length of token1 (excluding \0)
-    size_t len2 = strlen(token2); // Length of token2 (excluding \0)
-    char* pair_key = (char*)malloc(len1 + len2 + 2); // 1 for separator, 1 for \0
+// Adds delta to the frequency of the pair (left, right). Counts that drop to zero stay in the table
+// and are skipped by find_most_freq_pairs. When pair_queue is given, the new
+// count is pushed so the queue always holds every live count (older nodes for
+// the same pair go stale and are dropped by pop_most_freq_pair). Increments
+// with a position other than NO_POSITION also record where the pair starts;
+// decrements leave the position lists alone and the merge re-checks each site.
+void update_pair_frequency(HashTable* pair_freqs, PriorityQueue* pair_queue, uint32_t left, uint32_t right, int64_t delta, size_t position){
+	if(pair_freqs == NULL || delta == 0){
+		return;
+	}
+	uint64_t pair_key = create_pair_key(left, right);
+
+	HashEntry* entry = find_hash_entry(pair_freqs, &pair_key);
+	if(entry != NULL){
+		PairStats* stats = (PairStats*)entry->value;
+		if(delta > 0){
+			stats->frequency += (size_t)delta;
+		}else if(stats->frequency > (size_t)(-delta)){
+			stats->frequency -= (size_t)(-delta);
+		}else{
+			stats->frequency = 0;
+		}
+	}else if(delta > 0){
+		PairStats stats = { .frequency = (size_t)delta };
+		insert_into_hash_table(pair_freqs, (const void*)&pair_key, (const void*)&stats, sizeof(uint64_t), sizeof(PairStats));
+		if(pair_queue || position != NO_POSITION){
+			entry = find_hash_entry(pair_freqs, &pair_key);
+		}
+	}
+	if(entry && delta > 0 && position != NO_POSITION){
+		add_pair_position((PairStats*)entry->value, position);
+	}
+	if(pair_queue && entry && *(size_t*)entry->value > 0){
+		push_priority_queue(pair_queue, *(size_t*)entry->value, entry);
+	}
+}
 
-    if (pair_key == NULL) {
-        fprintf(stderr, "Error: Failed to allocate memory for pair key\n");
-        return NULL;
-    }
+// Refills pair_queue with one node per live pair in pair_freqs. Used after
+// the initial count and to drop the stale nodes that accumulate as counts change.
+void rebuild_pair_queue(Tokenizer* tokenizer){
+	if(tokenizer == NULL || tokenizer->pair_queue == NULL || tokenizer->pair_freqs == NULL){
+		return;
+	}
+	HashTable* table = tokenizer->pair_freqs;
+	reset_priority_queue(tokenizer->pair_queue);
+	for(size_t i = 0; i < table->capacity; i++){
+		HashEntry* entry = table->entries[i];
+		if(entry && entry->is_occupied && *(size_t*)entry->value > 0){
+			append_priority_queue(tokenizer->pair_queue, *(size_t*)entry->value, entry);
+		}
+	}
+	heapify_priority_queue(tokenizer->pair_queue);
+}
 
-    // Combine token1 and token2 into pair_key, separated by a space
-    sprintf(pair_key, "%s %s", token1, token2);
-    return pair_key;
+// Incremental counterpart of find_most_freq_pairs: pops nodes until one still
+// matches its pair's current count. HashEntry pointers stay valid across table
+// resizes, so nodes can refer to them directly.
+HashEntry* pop_most_freq_pair(Tokenizer* tokenizer){
+	if(tokenizer == NULL || tokenizer->pair_queue == NULL){
+		return NULL;
+	}
+	PriorityQueue* queue = tokenizer->pair_queue;
+	if(queue->size > 2 * tokenizer->pair_freqs->size + INITIAL_PAIR_FREQ_SIZE){
+		DEBUG_PAIR("Compacting pair queue: %zu nodes for %zu pairs\n", queue->size, tokenizer->pair_freqs->size);
+		rebuild_pair_queue(tokenizer);
+	}
+	HeapNode node;
+	while(pop_priority_queue(queue, &node)){
+		HashEntry* entry = (HashEntry*)node.item;
+		size_t freq = *(size_t*)entry->value;
+		if(freq > 0 && freq == node.priority){
+			return entry;
+		}
+	}
+	return NULL;
 }
+
 HashEntry* find_most_freq_pairs(HashTable* hash_table){
 	HashEntry* entry = NULL;
 	if(hash_table == NULL){
@@ -639,9 +1033,14 @@ HashEntry* find_most_freq_pairs(HashTable* hash_table){
 
 	if(!it) return NULL;
 
+	// Ties are broken on the key so every counting mode picks the same pair.
 	while(has_next(it)){
 		HashEntry* entry1 = get_next(it);
-		if(entry == NULL || (size_t)entry1->value > (size_t)entry->value){
+		if(!entry1) break;
+		size_t freq = *(size_t*)entry1->value;
+		if(freq == 0) continue; // fully merged pair left behind by incremental updates
+		if(entry == NULL || freq > *(size_t*)entry->value ||
+		   (freq == *(size_t*)entry->value && uint64_compare(entry1->key, entry->key) < 0)){
 			entry = entry1;
 		}
 	}
@@ -724,157 +1123,1685 @@ int token_exists_in_vocabulary(Tokenizer* tokenizer, const char* text){
 	return get_value(tokenizer->token_map,text,strcmp);
 }
 
-char*  merge_most_freq_pair(Token** tokenized_data, HashEntry* most_freq_pair, size_t* size){
-	char* text = strdup(most_freq_pair->key);
-
-	if(!text){
-		fprintf(stderr,"Error while duplicating most frequent pair\n");
+/*
+ * TokenSequence: index-linked id sequence used by training. A merge writes
+ * the merged id into the left slot and unlinks the right slot in O(1), so
+ * recorded pair positions stay valid. Holes are squeezed out by
+ * compact_token_sequence once they make up half of the slots.
+ */
+TokenSequence* create_token_sequence(size_t capacity){
+	TokenSequence* sequence = malloc(sizeof(TokenSequence));
+	if(!sequence){
+		fprintf(stderr, "Error: Could not allocate token sequence.\n");
 		return NULL;
 	}
-	Token* token1 = create_token(strtok(text," "));
-	Token* token2  = create_token(strtok(NULL, " "));
-
-	if(!token1 || !token2){
-		fprintf(stderr, "Error while tokenizing most frequent pair\n");
-		free(text);
-		if(token1) free_token(token1);
-		if(token2) free_token(token2);
-		return NULL;
+	if(capacity == 0){
+		capacity = 16;
 	}
-	Token* merged_token = merge_tokens(token1,token2);
-	if(merged_token == NULL){
-		fprintf(stderr,"Error: Failed to merge tokens %s and %s\n",token1->text, token2->text);
-		free_token(token1);
-		free_token(token2);
+	sequence->ids = malloc(capacity * sizeof(uint32_t));
+	sequence->weights = malloc(capacity * sizeof(size_t));
+	sequence->prev = malloc(capacity * sizeof(size_t));
+	sequence->next = malloc(capacity * sizeof(size_t));
+	if(!sequence->ids || !sequence->weights || !sequence->prev || !sequence->next){
+		fprintf(stderr, "Error: Could not allocate token sequence arrays.\n");
+		free(sequence->ids);
+		free(sequence->weights);
+		free(sequence->prev);
+		free(sequence->next);
+		free(sequence);
 		return NULL;
 	}
+	sequence->size = 0;
+	sequence->capacity = capacity;
+	sequence->live = 0;
+	return sequence;
+}
 
-	for(size_t i = 0; i < *size - 1;i++){
-		Token* current = tokenized_data[i];
-		Token* next = tokenized_data[i + 1];
+void free_token_sequence(TokenSequence* sequence){
+	if(!sequence){
+		return;
+	}
+	free(sequence->ids);
+	free(sequence->weights);
+	free(sequence->prev);
+	free(sequence->next);
+	free(sequence);
+}
 
-		if(current && next && strcmp(current->text, token1->text) == 0 && strcmp(next->text, token2->text) == 0){
-			free_token(current);
-			tokenized_data[i] = create_token(merged_token->text);
+// Appends id to the sequence. With link_to_previous the new slot forms a
+// pair with the slot before it; without it a new word starts here. weight is
+// the number of times the word occurs in the corpus (1 without deduplication).
+int append_to_token_sequence(TokenSequence* sequence, uint32_t id, size_t weight, bool link_to_previous){
+	if(!sequence){
+		return -1;
+	}
+	if(sequence->size >= sequence->capacity){
+		size_t new_capacity = sequence->capacity * 2;
+		uint32_t* ids = realloc(sequence->ids, new_capacity * sizeof(uint32_t));
+		if(!ids) return -1;
+		sequence->ids = ids;
+		size_t* weights = realloc(sequence->weights, new_capacity * sizeof(size_t));
+		if(!weights) return -1;
+		sequence->weights = weights;
+		size_t* prev = realloc(sequence->prev, new_capacity * sizeof(size_t));
+		if(!prev) return -1;
+		sequence->prev = prev;
+		size_t* next = realloc(sequence->next, new_capacity * sizeof(size_t));
+		if(!next) return -1;
+		sequence->next = next;
+		sequence->capacity = new_capacity;
+	}
+	size_t index = sequence->size++;
+	sequence->ids[index] = id;
+	sequence->weights[index] = weight;
+	sequence->next[index] = NO_POSITION;
+	sequence->prev[index] = NO_POSITION;
+	if(link_to_previous && index > 0 && sequence->ids[index - 1] != NO_TOKEN){
+		sequence->prev[index] = index - 1;
+		sequence->next[index - 1] = index;
+	}
+	sequence->live++;
+	return 0;
+}
 
-			free_token(next);
-			tokenized_data[i + 1] = NULL;
-			for(size_t j = i + 1; j < *size - 1; j++){
-				tokenized_data[j] = tokenized_data[j + 1];
-			}
-			tokenized_data[*size - 1] = NULL;
-			(*size)--;
-			i--;
-		}
-	}
-	free_token(token1);
-	free_token(token2);
-	//tokenized_data[size] = NULL;
-	// Cleanup
-	//free_dataset(dataset);
-	free(text);
-	char* result = strdup(merged_token->text);
-	if(!result){
-		DEBUG_MEM("Failed to duplicate merged tokens string.");
+// token_map is stored sequentially, so build a hashed text -> id lookup once
+// instead of scanning it for every token.
+static HashTable* build_id_lookup(Tokenizer* tokenizer){
+	HashTable* ids_by_text = create_hash_table(2 * tokenizer->token_map->size + 1);
+	if(!ids_by_text){
 		return NULL;
 	}
-
-	free_token(merged_token);
-	return result;
-	//free(tokens);
-
+	for(size_t i = 0; i < tokenizer->token_map->capacity; i++){
+		HashEntry* entry = tokenizer->token_map->entries[i];
+		if(entry && entry->is_occupied){
+			insert_into_hash_table(ids_by_text, entry->key, entry->value, strlen((const char*)entry->key) + 1, sizeof(size_t));
+		}
+	}
+	return ids_by_text;
 }
 
-Token* create_token_with_frequency(const char* text, size_t freq){
-	Token* res = create_token(text);
-	if(!res){ DEBUG_TOK("Error could not create new token."); return NULL;}
+/*
+ * Converts the output of tokenize() into token ids. Every token must already
+ * be in the vocabulary (initialize_vocabulary). Tokens that can never be part
+ * of a pair are dropped and break the link between their neighbours.
+ */
+TokenSequence* tokens_to_sequence(Tokenizer* tokenizer, Token** tokens, size_t num_tokens){
+	if(tokenizer == NULL || tokens == NULL){
+		return NULL;
+	}
+	HashTable* ids_by_text = build_id_lookup(tokenizer);
+	if(!ids_by_text){
+		return NULL;
+	}
 
-	res->frequency = freq;
-	return res;
+	TokenSequence* sequence = create_token_sequence(num_tokens);
+	if(!sequence){
+		free_hash_table(ids_by_text);
+		return NULL;
+	}
+	bool link = false;
+	for(size_t i = 0; i < num_tokens; i++){
+		size_t id;
+		if(tokens[i] == NULL || !token_is_pairable(tokens[i]->text) ||
+		   get_value(ids_by_text, tokens[i]->text, &id) != 0){
+			link = false;
+			continue;
+		}
+		if(append_to_token_sequence(sequence, (uint32_t)id, 1, link) != 0){
+			fprintf(stderr, "Error: Could not grow token sequence.\n");
+			free_token_sequence(sequence);
+			free_hash_table(ids_by_text);
+			return NULL;
+		}
+		link = true;
+	}
+	free_hash_table(ids_by_text);
+	return sequence;
 }
 
+/*
+ * Byte-level mode. The vocabulary starts with one token per byte value, and
+ * the token of byte b sits in slot b, so its id is the byte itself. Building
+ * the training sequence is then a single scan that counts bytes into an
+ * array: no character tokens are allocated and token_map is never searched.
+ */
+int seed_byte_vocabulary(Tokenizer* tokenizer){
+	if(tokenizer == NULL){
+		return -1;
+	}
+	if(tokenizer->vocab_size != 0 || tokenizer->max_vocab_size < BYTE_ALPHABET_SIZE){
+		fprintf(stderr, "Error: The byte alphabet needs an empty vocabulary of at least %d tokens.\n", BYTE_ALPHABET_SIZE);
+		return -1;
+	}
+	char text[2] = {0, 0};
+	for(size_t b = 0; b < BYTE_ALPHABET_SIZE; b++){
+		text[0] = (char)b;
+		Token* token = create_token_with_frequency(text, 0);
+		if(token == NULL){
+			return -1;
+		}
+		token->length = 1;  // byte 0 reads as an empty string but is one byte
+		tokenizer->vocabulary[b] = token;
+		if(append_to_token_map(tokenizer->token_map, text, b) != 0){
+			return -1;
+		}
+		tokenizer->vocab_size++;
+	}
+	return 0;
+}
 
-void add_merged_token(Tokenizer* tokenizer, const char* text, size_t freq){
-	size_t ind;
-	int index = get_value(tokenizer->token_map, text, &ind);
-
-	if(index >=0){
-		tokenizer->vocabulary[ind]->frequency += freq;
-	}else{
-		index = tokenizer->token_map->ops.hash_function(text) % tokenizer->max_vocab_size;
-		size_t step = 0;
-		while(step < tokenizer->max_vocab_size){
-			size_t probing_index = (index + step*step) % tokenizer->max_vocab_size;
-			if(tokenizer->vocabulary[probing_index] == NULL){
-				Token* token = create_token_with_frequency(text, freq);
-				if(!token){ DEBUG_TOK("Error: Failed to create token for %s", text); return;}
-				tokenizer->vocabulary[probing_index] = token;
-				insert_into_token_map(tokenizer->token_map, text, probing_index);
-				tokenizer->vocab_size++;
-				return;
-			}
-			step++;
+// Appends the bytes of text to sequence, one linked run per word, and adds
+// weight to the byte counts. Control bytes cannot be paired and break the
+// run; bytes >= 0x80 are linked, so merges can form inside and around
+// multi-byte UTF-8 characters.
+static int append_byte_word(TokenSequence* sequence, size_t* byte_counts, const char* word, size_t weight){
+	bool link = false;
+	for(const unsigned char* c = (const unsigned char*)word; *c != '\0'; c++){
+		byte_counts[*c] += weight;
+		if(*c < 0x20 || *c == 0x7F){
+			link = false;
+			continue;
 		}
-		DEBUG_TOK("Failed to add merged token %s to the vocabulary",text);
+		if(append_to_token_sequence(sequence, *c, weight, link) != 0){
+			fprintf(stderr, "Error: Could not grow token sequence.\n");
+			return -1;
+		}
+		link = true;
 	}
+	return 0;
+}
 
+static void add_byte_counts(Tokenizer* tokenizer, const size_t* byte_counts){
+	for(size_t b = 0; b < BYTE_ALPHABET_SIZE; b++){
+		tokenizer->vocabulary[b]->frequency += byte_counts[b];
+	}
 }
-// Code to implement BPE
-//
 
-void BPE(Tokenizer* tokenizer, TextFile* dataset){
-	// Null check to avoid uneccessary seg fault.
-	if(tokenizer == NULL || dataset ==NULL){
-		fprintf(stderr,"Tokenizer or dataset is empty or NULL\n");
-		return;
+static TokenSequence* words_to_byte_sequence(Tokenizer* tokenizer, const WordCounts* words){
+	if(tokenizer->vocab_size == 0 && seed_byte_vocabulary(tokenizer) != 0){
+		return NULL;
 	}
-	// Step 1: tokenized the dataset by characters
-	size_t num_tokens = 0;
-	Token** tokenized_data = tokenize(dataset,"",&num_tokens);
-	if(tokenized_data == NULL || num_tokens == 0){
-		fprintf(stderr,"Error: Could not tokenize dataset or zero token\n");
-		return;
+	size_t total_bytes = 0;
+	for(size_t w = 0; w < words->num_words; w++){
+		total_bytes += strlen(words->words[w]);
 	}
-	
-	//printf("Starting BPE with %zu lines of text\n", dataset->num_lines);
-    	DEBUG_TOK("\nInitial tokens: %zu\n", num_tokens);
-	
-	// Initialize the vocabulary to include tokens consisting of individual characters
-	DEBUG_TOK("Initializing Vocabulary...");
+	size_t byte_counts[BYTE_ALPHABET_SIZE] = {0};
+	TokenSequence* sequence = create_token_sequence(total_bytes);
+	if(!sequence){
+		return NULL;
+	}
+	for(size_t w = 0; w < words->num_words; w++){
+		if(append_byte_word(sequence, byte_counts, words->words[w], words->counts[w]) != 0){
+			free_token_sequence(sequence);
+			return NULL;
+		}
+	}
+	add_byte_counts(tokenizer, byte_counts);
+	return sequence;
+}
 
-	initialize_vocabulary(tokenizer,dataset);
-	size_t merges = 0;
-	DEBUG_TOK("Vocabulary initialized.");
-	size_t counter = 0;
-	while(tokenizer->vocab_size < MAX_VOCAB_SIZE || counter < 2*MAX_VOCAB_SIZE){
+// Reads file once and returns its byte sequence, splitting words like
+// tokenize() does. Used by BPE() in byte-level mode without deduplication.
+TokenSequence* file_to_byte_sequence(Tokenizer* tokenizer, TextFile* file){
+	if(tokenizer == NULL || file == NULL){
+		return NULL;
+	}
+	if(tokenizer->vocab_size == 0 && seed_byte_vocabulary(tokenizer) != 0){
+		return NULL;
+	}
+	if(open_text_file(file, "r") == -1){
+		fprintf(stderr,"error opening textfile.\n");
+		return NULL;
+	}
+	size_t byte_counts[BYTE_ALPHABET_SIZE] = {0};
+	TokenSequence* sequence = create_token_sequence(1024);
+	DelimiterSet spaces;
+	make_delimiter_set(&spaces, " ");
+	char* line = NULL;
+	int result = sequence ? 0 : -1;
+	while(result == 0 && read_line(file, &line) == 0){
+		size_t length = strlen(line);
+		Pretokenizer pretokenizer;
+		init_pretokenizer(&pretokenizer, tokenizer->pretokenizer, &spaces, line, length);
+		WordSpan span;
+		while(result == 0 && next_pretoken(&pretokenizer, &span)){
+			char* end = line + span.offset + span.length;
+			char after = *end;
+			*end = '\0';
+			result = append_byte_word(sequence, byte_counts, line + span.offset, 1);
+			*end = after;
+		}
+		free(line);
+	}
+	if(result == 0 && ferror(file->file_handle)){
+		fprintf(stderr, "Error: Could not read %s.\n", file->filepath);
+		result = -1;
+	}
+	close_text_file(file);
+	if(result != 0){
+		free_token_sequence(sequence);
+		return NULL;
+	}
+	add_byte_counts(tokenizer, byte_counts);
+	return sequence;
+}
+
+// Copies the UTF-8 character at the start of text into character, the way
+// split_utf8_characters splits it, and returns its length in bytes.
+static size_t next_character(const char* text, size_t length, char* character, size_t* invalid){
+	size_t char_length = utf8_char_length(text, length);
+	if(char_length == 0){
+		if(invalid) (*invalid)++;
+		char_length = 1;
+	}
+	memcpy(character, text, char_length);
+	character[char_length] = '\0';
+	return char_length;
+}
+
+/*
+ * Builds the vocabulary and the training sequence from deduplicated words.
+ * Each unique word appears once in the sequence with its count as weight, so
+ * pair counts come out the same as over the full corpus. Words are visited in
+ * first occurrence order and characters are added with their corpus counts,
+ * which gives the same vocabulary as initialize_vocabulary on the full text.
+ */
+TokenSequence* words_to_sequence(Tokenizer* tokenizer, const WordCounts* words){
+	if(tokenizer == NULL || words == NULL){
+		return NULL;
+	}
+	if(tokenizer->byte_level){
+		return words_to_byte_sequence(tokenizer, words);
+	}
+	char character[UTF8_MAX_CHAR_LEN + 1];
+	size_t total_chars = 0;
+	size_t invalid = 0;
+	for(size_t w = 0; w < words->num_words; w++){
+		const char* word = words->words[w];
+		size_t length = strlen(word);
+		for(size_t c = 0; c < length; ){
+			size_t char_length = next_character(word + c, length - c, character, &invalid);
+			add_to_vocabulary_with_frequency(tokenizer, character, words->counts[w]);
+			c += char_length;
+		}
+		add_to_vocabulary_with_frequency(tokenizer, "\x1f", words->counts[w]);
+		total_chars += length;
+	}
+	if(invalid > 0){
+		fprintf(stderr, "Warning: %zu invalid UTF-8 sequences kept as single bytes\n", invalid);
+	}
+
+	HashTable* ids_by_text = build_id_lookup(tokenizer);
+	if(!ids_by_text){
+		return NULL;
+	}
+	TokenSequence* sequence = create_token_sequence(total_chars);
+	if(!sequence){
+		free_hash_table(ids_by_text);
+		return NULL;
+	}
+	for(size_t w = 0; w < words->num_words; w++){
+		const char* word = words->words[w];
+		size_t length = strlen(word);
+		bool link = false;
+		for(size_t c = 0; c < length; ){
+			size_t id;
+			c += next_character(word + c, length - c, character, NULL);
+			if(!token_is_pairable(character) || get_value(ids_by_text, character, &id) != 0){
+				link = false;
+				continue;
+			}
+			if(append_to_token_sequence(sequence, (uint32_t)id, words->counts[w], link) != 0){
+				fprintf(stderr, "Error: Could not grow token sequence.\n");
+				free_token_sequence(sequence);
+				free_hash_table(ids_by_text);
+				return NULL;
+			}
+			link = true;
+		}
+	}
+	free_hash_table(ids_by_text);
+	return sequence;
+}
+
+// Writes merged into the slot at index and unlinks its successor.
+static void merge_sequence_tokens(TokenSequence* sequence, size_t index, uint32_t merged){
+	size_t right = sequence->next[index];
+	size_t after = sequence->next[right];
+	sequence->ids[index] = merged;
+	sequence->ids[right] = NO_TOKEN;
+	sequence->next[index] = after;
+	if(after != NO_POSITION) sequence->prev[after] = index;
+	sequence->prev[right] = NO_POSITION;
+	sequence->next[right] = NO_POSITION;
+	sequence->live--;
+}
+
+/*
+ * Moves the live slots to the front of the arrays and rewrites the position
+ * lists in pair_freqs to the new indices. Positions that point at holes are
+ * stale by definition and are dropped.
+ */
+void compact_token_sequence(TokenSequence* sequence, HashTable* pair_freqs){
+	if(!sequence || sequence->live == sequence->size){
+		return;
+	}
+	// Reuse prev as the old -> new index map; it is rebuilt from next below.
+	size_t* remap = sequence->prev;
+	size_t write = 0;
+	for(size_t read = 0; read < sequence->size; read++){
+		remap[read] = sequence->ids[read] == NO_TOKEN ? NO_POSITION : write++;
+	}
+	// remap[read] <= read, so every slot is read before it is overwritten.
+	for(size_t read = 0; read < sequence->size; read++){
+		size_t to = remap[read];
+		if(to == NO_POSITION) continue;
+		size_t next = sequence->next[read];
+		sequence->ids[to] = sequence->ids[read];
+		sequence->weights[to] = sequence->weights[read];
+		sequence->next[to] = next == NO_POSITION ? NO_POSITION : remap[next];
+	}
+
+	if(pair_freqs){
+		for(size_t i = 0; i < pair_freqs->capacity; i++){
+			HashEntry* entry = pair_freqs->entries[i];
+			if(!entry || !entry->is_occupied) continue;
+			PairStats* stats = (PairStats*)entry->value;
+			size_t kept = 0;
+			for(size_t k = 0; k < stats->num_positions; k++){
+				size_t position = remap[stats->positions[k]];
+				if(position != NO_POSITION){
+					stats->positions[kept++] = position;
+				}
+			}
+			stats->num_positions = kept;
+		}
+	}
+
+	for(size_t i = 0; i < write; i++){
+		sequence->prev[i] = NO_POSITION;
+	}
+	for(size_t i = 0; i < write; i++){
+		if(sequence->next[i] != NO_POSITION){
+			sequence->prev[sequence->next[i]] = i;
+		}
+	}
+	sequence->size = write;
+	sequence->live = write;
+	DEBUG_PAIR("Compacted token sequence to %zu tokens\n", write);
+}
+
+/*
+ * Full recount path: applies the merge of most_freq_pair at every site in one
+ * left to right pass over the sequence. Returns the number of sites merged.
+ */
+size_t merge_most_freq_pair(TokenSequence* sequence, HashEntry* most_freq_pair, uint32_t merged){
+	if(sequence == NULL || most_freq_pair == NULL){
+		fprintf(stderr,"Error: Invalid arguments to merge\n");
+		return 0;
+	}
+	uint64_t key = *(const uint64_t*)most_freq_pair->key;
+	uint32_t left = pair_key_left(key);
+	uint32_t right = pair_key_right(key);
+
+	size_t sites = 0;
+	for(size_t i = 0; i < sequence->size; i++){
+		size_t next = sequence->next[i];
+		if(next == NO_POSITION || sequence->ids[i] != left || sequence->ids[next] != right){
+			continue;
+		}
+		// The merged id can never start another site, and the right slot
+		// becomes a hole, so the scan just carries on.
+		merge_sequence_tokens(sequence, i, merged);
+		sites++;
+	}
+	if(sequence->live < sequence->size / 2){
+		compact_token_sequence(sequence, NULL);
+	}
+	return sites;
+}
+
+static int compare_positions(const void* a, const void* b){
+	size_t x = *(const size_t*)a;
+	size_t y = *(const size_t*)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Incremental variant of merge_most_freq_pair used when
+ * tokenizer->incremental_pairs is set. Only the positions recorded for the
+ * pair are visited, and each merge site (prev, left, right, next) updates just
+ * the pairs it touches:
+ *   - (prev, left), (left, right) and (right, next) lose one occurrence
+ *   - (prev, merged) and (merged, next) gain one occurrence
+ * Positions are never removed when a pair loses an occurrence; a site is
+ * merged only if it still holds (left, right). Sites are visited in
+ * increasing order, exactly like the full recount path, so overlapping pairs
+ * such as "a a a" end up with the same counts. Returns the number of sites
+ * merged.
+ */
+size_t merge_most_freq_pair_incremental(Tokenizer* tokenizer, TokenSequence* sequence, HashEntry* most_freq_pair, uint32_t merged){
+	if(tokenizer == NULL || sequence == NULL || most_freq_pair == NULL){
+		fprintf(stderr,"Error: Invalid arguments to incremental merge\n");
+		return 0;
+	}
+	uint64_t key = *(const uint64_t*)most_freq_pair->key;
+	uint32_t left = pair_key_left(key);
+	uint32_t right = pair_key_right(key);
+
+	HashTable* pair_freqs = tokenizer->pair_freqs;
+	PriorityQueue* pair_queue = tokenizer->pair_queue;
+
+	// Merging never creates (left, right) again, so this list is stable while
+	// we walk it even though other pairs gain positions.
+	PairStats* stats = (PairStats*)most_freq_pair->value;
+	qsort(stats->positions, stats->num_positions, sizeof(size_t), compare_positions);
+
+	size_t sites = 0;
+	for(size_t p = 0; p < stats->num_positions; p++){
+		size_t i = stats->positions[p];
+		if(p > 0 && stats->positions[p - 1] == i) continue;
+		size_t j = sequence->next[i];
+		if(j == NO_POSITION || sequence->ids[i] != left || sequence->ids[j] != right) continue;
+
+		size_t prev = sequence->prev[i];
+		size_t after = sequence->next[j];
+		// Linked slots belong to the same word, so they share its weight.
+		int64_t weight = (int64_t)sequence->weights[i];
+
+		if(prev != NO_POSITION) update_pair_frequency(pair_freqs, pair_queue, sequence->ids[prev], left, -weight, NO_POSITION);
+		update_pair_frequency(pair_freqs, pair_queue, left, right, -weight, NO_POSITION);
+		if(after != NO_POSITION) update_pair_frequency(pair_freqs, pair_queue, right, sequence->ids[after], -weight, NO_POSITION);
+
+		merge_sequence_tokens(sequence, i, merged);
+		sites++;
+
+		if(prev != NO_POSITION) update_pair_frequency(pair_freqs, pair_queue, sequence->ids[prev], merged, weight, prev);
+		if(after != NO_POSITION) update_pair_frequency(pair_freqs, pair_queue, merged, sequence->ids[after], weight, i);
+	}
+	// Every site has been merged, so the list is dead weight from here on.
+	free(stats->positions);
+	stats->positions = NULL;
+	stats->num_positions = 0;
+	stats->positions_capacity = 0;
+
+	if(sequence->live < sequence->size / 2){
+		compact_token_sequence(sequence, pair_freqs);
+	}
+	return sites;
+}
+
+Token* create_token_with_frequency(const char* text, size_t freq){
+	Token* res = create_token(text);
+	if(!res){ DEBUG_TOK("Error could not create new token."); return NULL;}
+
+	res->frequency = freq;
+	return res;
+}
+
+
+// Adds a merged token to the vocabulary, or adds freq to it if the text is
+// already there. Returns the token's vocabulary index, which is its id, or
+// NO_POSITION if the vocabulary has no room left.
+size_t add_merged_token(Tokenizer* tokenizer, const char* text, size_t freq){
+	size_t ind;
+	int index = get_value(tokenizer->token_map, text, &ind);
+
+	if(index >=0){
+		tokenizer->vocabulary[ind]->frequency += freq;
+		return ind;
+	}
+	if(tokenizer->vocab_size >= tokenizer->max_vocab_size){
+		DEBUG_TOK("Failed to add merged token %s: vocabulary is full\n",text);
+		return NO_POSITION;
+	}
+	size_t start = tokenizer->token_map->ops.hash_function(text) % tokenizer->max_vocab_size;
+	size_t slot = NO_POSITION;
+	for(size_t step = 0; step < tokenizer->max_vocab_size; step++){
+		size_t probing_index = (start + step*step) % tokenizer->max_vocab_size;
+		if(tokenizer->vocabulary[probing_index] == NULL){
+			slot = probing_index;
+			break;
+		}
+	}
+	// Quadratic probing does not reach every slot; fall back to a linear scan
+	// so a nearly full vocabulary can still take new tokens.
+	for(size_t i = 0; slot == NO_POSITION && i < tokenizer->max_vocab_size; i++){
+		if(tokenizer->vocabulary[i] == NULL){
+			slot = i;
+		}
+	}
+	if(slot == NO_POSITION){
+		DEBUG_TOK("Failed to add merged token %s to the vocabulary",text);
+		return NO_POSITION;
+	}
+	Token* token = create_token_with_frequency(text, freq);
+	if(!token){ DEBUG_TOK("Error: Failed to create token for %s", text); return NO_POSITION;}
+	if(insert_into_token_map(tokenizer->token_map, text, slot) != 0){
+		free_token(token);
+		return NO_POSITION;
+	}
+	tokenizer->vocabulary[slot] = token;
+	tokenizer->vocab_size++;
+	return slot;
+}
+
+// Records a learned merge; its index in tokenizer->merges is its rank.
+int add_merge(Tokenizer* tokenizer, uint32_t left, uint32_t right, uint32_t merged, size_t frequency){
+	if(tokenizer == NULL){
+		return -1;
+	}
+	if(tokenizer->num_merges >= tokenizer->merges_capacity){
+		size_t new_capacity = tokenizer->merges_capacity ? tokenizer->merges_capacity * 2 : 256;
+		BPEMerge* merges = realloc(tokenizer->merges, new_capacity * sizeof(BPEMerge));
+		if(!merges){
+			DEBUG_MEM("Error: Could not grow merge list to %zu\n", new_capacity);
+			return -1;
+		}
+		tokenizer->merges = merges;
+		tokenizer->merges_capacity = new_capacity;
+	}
+	BPEMerge* merge = &tokenizer->merges[tokenizer->num_merges++];
+	merge->left = left;
+	merge->right = right;
+	merge->merged = merged;
+	merge->frequency = frequency;
+	return 0;
+}
+
+/*
+ * WordCounts: unique words of a corpus with their number of occurrences, in
+ * the order they were first seen. index maps a word to its position in words.
+ */
+WordCounts* create_word_counts(size_t initial_capacity){
+	WordCounts* counts = malloc(sizeof(WordCounts));
+	if(!counts){
+		fprintf(stderr, "Error: Could not allocate word counts.\n");
+		return NULL;
+	}
+	if(initial_capacity == 0){
+		initial_capacity = 64;
+	}
+	counts->index = create_hash_table(2 * initial_capacity);
+	counts->words = malloc(initial_capacity * sizeof(char*));
+	counts->counts = malloc(initial_capacity * sizeof(size_t));
+	if(!counts->index || !counts->words || !counts->counts){
+		fprintf(stderr, "Error: Could not allocate word counts.\n");
+		free_hash_table(counts->index);
+		free(counts->words);
+		free(counts->counts);
+		free(counts);
+		return NULL;
+	}
+	counts->num_words = 0;
+	counts->capacity = initial_capacity;
+	counts->total = 0;
+	return counts;
+}
+
+void free_word_counts(WordCounts* counts){
+	if(!counts){
+		return;
+	}
+	for(size_t i = 0; i < counts->num_words; i++){
+		free(counts->words[i]);
+	}
+	free(counts->words);
+	free(counts->counts);
+	free_hash_table(counts->index);
+	free(counts);
+}
+
+// Adds count occurrences of word.
+int add_word_count(WordCounts* counts, const char* word, size_t count){
+	if(!counts || !word || word[0] == '\0'){
+		return -1;
+	}
+	counts->total += count;
+	HashEntry* entry = find_hash_entry(counts->index, word);
+	if(entry){
+		counts->counts[*(size_t*)entry->value] += count;
+		return 0;
+	}
+	if(counts->num_words >= counts->capacity){
+		size_t new_capacity = counts->capacity * 2;
+		char** words = realloc(counts->words, new_capacity * sizeof(char*));
+		if(!words) return -1;
+		counts->words = words;
+		size_t* new_counts = realloc(counts->counts, new_capacity * sizeof(size_t));
+		if(!new_counts) return -1;
+		counts->counts = new_counts;
+		counts->capacity = new_capacity;
+	}
+	char* copy = strdup(word);
+	if(!copy){
+		return -1;
+	}
+	size_t index = counts->num_words;
+	if(insert_into_hash_table(counts->index, word, &index, strlen(word) + 1, sizeof(size_t)) != 0){
+		free(copy);
+		return -1;
+	}
+	counts->words[index] = copy;
+	counts->counts[index] = count;
+	counts->num_words++;
+	return 0;
+}
+
+// Splits a line into words the same way tokenize() does and counts them.
+int add_line_words(WordCounts* counts, char* line, PretokenizerMode mode){
+	DelimiterSet spaces;
+	make_delimiter_set(&spaces, " ");
+	size_t length = strlen(line);
+	Pretokenizer pretokenizer;
+	init_pretokenizer(&pretokenizer, mode, &spaces, line, length);
+	WordSpan span;
+	while(next_pretoken(&pretokenizer, &span)){
+		char* end = line + span.offset + span.length;
+		char after = *end;
+		*end = '\0';
+		int result = add_word_count(counts, line + span.offset, 1);
+		*end = after;
+		if(result != 0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Pre-pass for training: reads the file once and returns its unique words.
+WordCounts* count_words(TextFile* file, PretokenizerMode mode){
+	if(file == NULL){
+		return NULL;
+	}
+	if(open_text_file(file, "r") == -1){
+		fprintf(stderr,"error opening textfile.\n");
+		return NULL;
+	}
+	WordCounts* counts = create_word_counts(1024);
+	if(!counts){
+		close_text_file(file);
+		return NULL;
+	}
+	char* line = NULL;
+	while(read_line(file, &line) == 0){
+		int res = add_line_words(counts, line, mode);
+		free(line);
+		if(res != 0){
+			fprintf(stderr, "Error: Failed to count words\n");
+			free_word_counts(counts);
+			close_text_file(file);
+			return NULL;
+		}
+	}
+	// read_line fails at the end of the file and on read errors alike.
+	if(ferror(file->file_handle)){
+		fprintf(stderr, "Error: Could not read %s.\n", file->filepath);
+		free_word_counts(counts);
+		close_text_file(file);
+		return NULL;
+	}
+	close_text_file(file);
+	return counts;
+}
+
+/*
+ * Out-of-core word counting. The file is read in chunks of chunk_size bytes
+ * and words are counted in memory until max_words unique words are held.
+ * The counts are then sorted by word and spilled to a temporary run file.
+ * At the end the runs are merged, so memory is bounded by the number of
+ * unique words (plus one chunk), not by the size of the corpus.
+ *
+ * Run records: word length, word bytes, count, first_seen. first_seen orders
+ * words by first occurrence across runs: a run started after `base` words had
+ * been read and lists its words in first occurrence order, so base + index
+ * grows with the position of the first occurrence.
+ */
+typedef struct {
+	char* word;
+	size_t length;
+	size_t count;
+	size_t first_seen;
+} WordRecord;
+
+static int compare_records_by_word(const void* a, const void* b){
+	return strcmp(((const WordRecord*)a)->word, ((const WordRecord*)b)->word);
+}
+
+static int compare_records_by_first_seen(const void* a, const void* b){
+	size_t x = ((const WordRecord*)a)->first_seen;
+	size_t y = ((const WordRecord*)b)->first_seen;
+	return (x > y) - (x < y);
+}
+
+static int write_word_record(FILE* run, const WordRecord* record){
+	if(fwrite(&record->length, sizeof(size_t), 1, run) != 1) return -1;
+	if(fwrite(record->word, 1, record->length, run) != record->length) return -1;
+	if(fwrite(&record->count, sizeof(size_t), 1, run) != 1) return -1;
+	if(fwrite(&record->first_seen, sizeof(size_t), 1, run) != 1) return -1;
+	return 0;
+}
+
+// Reads the next record into record, reusing record->word. Returns 1 on
+// success, 0 at the end of the run and -1 on error.
+static int read_word_record(FILE* run, WordRecord* record, size_t* word_capacity){
+	size_t length;
+	if(fread(&length, sizeof(size_t), 1, run) != 1){
+		return feof(run) ? 0 : -1;
+	}
+	if(length + 1 > *word_capacity){
+		char* word = realloc(record->word, length + 1);
+		if(!word) return -1;
+		record->word = word;
+		*word_capacity = length + 1;
+	}
+	if(fread(record->word, 1, length, run) != length) return -1;
+	record->word[length] = '\0';
+	record->length = length;
+	if(fread(&record->count, sizeof(size_t), 1, run) != 1) return -1;
+	if(fread(&record->first_seen, sizeof(size_t), 1, run) != 1) return -1;
+	return 1;
+}
+
+// Writes counts to a new run sorted by word. The run is a tmpfile(), so it
+// disappears when closed.
+static FILE* spill_word_counts(const WordCounts* counts, size_t base){
+	WordRecord* records = malloc(counts->num_words * sizeof(WordRecord));
+	FILE* run = tmpfile();
+	if(!records || !run){
+		fprintf(stderr, "Error: Could not create a word count run.\n");
+		free(records);
+		if(run) fclose(run);
+		return NULL;
+	}
+	for(size_t i = 0; i < counts->num_words; i++){
+		records[i].word = counts->words[i];
+		records[i].length = strlen(counts->words[i]);
+		records[i].count = counts->counts[i];
+		records[i].first_seen = base + i;
+	}
+	qsort(records, counts->num_words, sizeof(WordRecord), compare_records_by_word);
+	for(size_t i = 0; i < counts->num_words; i++){
+		if(write_word_record(run, &records[i]) != 0){
+			fprintf(stderr, "Error: Could not write a word count run.\n");
+			free(records);
+			fclose(run);
+			return NULL;
+		}
+	}
+	free(records);
+	rewind(run);
+	DEBUG_TOK("Spilled %zu words to disk\n", counts->num_words);
+	return run;
+}
+
+// k-way merge of sorted runs. Counts of the same word are summed and the
+// result is returned in first occurrence order.
+static WordCounts* merge_word_runs(FILE** runs, size_t num_runs){
+	WordRecord* heads = calloc(num_runs, sizeof(WordRecord));
+	size_t* head_capacity = calloc(num_runs, sizeof(size_t));
+	bool* live = calloc(num_runs, sizeof(bool));
+	WordRecord* merged = NULL;
+	size_t num_merged = 0, merged_capacity = 0;
+	WordCounts* result = NULL;
+	bool failed = !heads || !head_capacity || !live;
+
+	for(size_t r = 0; r < num_runs && !failed; r++){
+		int status = read_word_record(runs[r], &heads[r], &head_capacity[r]);
+		failed = status < 0;
+		live[r] = status == 1;
+	}
+	while(!failed){
+		size_t smallest = num_runs;
+		for(size_t r = 0; r < num_runs; r++){
+			if(live[r] && (smallest == num_runs || strcmp(heads[r].word, heads[smallest].word) < 0)){
+				smallest = r;
+			}
+		}
+		if(smallest == num_runs){
+			break; // all runs consumed
+		}
+		if(num_merged >= merged_capacity){
+			size_t new_capacity = merged_capacity ? merged_capacity * 2 : 1024;
+			WordRecord* tmp = realloc(merged, new_capacity * sizeof(WordRecord));
+			if(!tmp){
+				failed = true;
+				break;
+			}
+			merged = tmp;
+			merged_capacity = new_capacity;
+		}
+		WordRecord* out = &merged[num_merged];
+		out->word = strdup(heads[smallest].word);
+		if(!out->word){
+			failed = true;
+			break;
+		}
+		out->length = heads[smallest].length;
+		out->count = 0;
+		out->first_seen = heads[smallest].first_seen;
+		num_merged++;
+
+		for(size_t r = 0; r < num_runs; r++){
+			if(!live[r] || strcmp(heads[r].word, out->word) != 0){
+				continue;
+			}
+			out->count += heads[r].count;
+			if(heads[r].first_seen < out->first_seen){
+				out->first_seen = heads[r].first_seen;
+			}
+			int status = read_word_record(runs[r], &heads[r], &head_capacity[r]);
+			if(status < 0){
+				failed = true;
+			}
+			live[r] = status == 1;
+		}
+	}
+
+	if(!failed){
+		qsort(merged, num_merged, sizeof(WordRecord), compare_records_by_first_seen);
+		result = create_word_counts(num_merged);
+		for(size_t i = 0; result && i < num_merged; i++){
+			if(add_word_count(result, merged[i].word, merged[i].count) != 0){
+				free_word_counts(result);
+				result = NULL;
+			}
+		}
+	}
+	if(!result){
+		fprintf(stderr, "Error: Could not merge word count runs.\n");
+	}
+	for(size_t i = 0; i < num_merged; i++){
+		free(merged[i].word);
+	}
+	for(size_t r = 0; heads && r < num_runs; r++){
+		free(heads[r].word);
+	}
+	free(merged);
+	free(heads);
+	free(head_capacity);
+	free(live);
+	return result;
+}
+
+typedef struct {
+	WordCounts* counts;       // Words since the last spill
+	size_t base;              // Words read before counts was started
+	size_t max_words;         // Spill once counts holds this many words, 0 never
+	FILE** runs;
+	size_t num_runs;
+	size_t runs_capacity;
+} WordStream;
+
+// Moves the words counted so far into a new run on disk.
+static int stream_spill(WordStream* stream){
+	if(stream->num_runs >= stream->runs_capacity){
+		size_t new_capacity = stream->runs_capacity ? stream->runs_capacity * 2 : 8;
+		FILE** runs = realloc(stream->runs, new_capacity * sizeof(FILE*));
+		if(!runs) return -1;
+		stream->runs = runs;
+		stream->runs_capacity = new_capacity;
+	}
+	FILE* run = spill_word_counts(stream->counts, stream->base);
+	if(!run){
+		return -1;
+	}
+	stream->runs[stream->num_runs++] = run;
+	stream->base += stream->counts->total;
+	free_word_counts(stream->counts);
+	stream->counts = create_word_counts(stream->max_words);
+	return stream->counts ? 0 : -1;
+}
+
+static int stream_add_word(WordStream* stream, const char* word){
+	if(add_word_count(stream->counts, word, 1) != 0){
+		return -1;
+	}
+	if(stream->max_words > 0 && stream->counts->num_words >= stream->max_words){
+		return stream_spill(stream);
+	}
+	return 0;
+}
+
+// Counts the words of a terminated piece of text that holds no boundary.
+// In spaces mode the piece is a single word; in GPT-2 mode it is a line.
+static int stream_add_text(WordStream* stream, char* text, PretokenizerMode mode){
+	if(mode != PRETOKENIZE_GPT2){
+		return stream_add_word(stream, text);
+	}
+	size_t length = strlen(text);
+	Pretokenizer pretokenizer;
+	init_pretokenizer(&pretokenizer, PRETOKENIZE_GPT2, NULL, text, length);
+	WordSpan span;
+	while(next_gpt2_span(&pretokenizer, &span)){
+		char* end = text + span.offset + span.length;
+		char after = *end;
+		*end = '\0';
+		int result = stream_add_word(stream, text + span.offset);
+		*end = after;
+		if(result != 0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Streaming counterpart of count_words. Words are separated by spaces and
+ * newlines. A word cut by a chunk boundary is carried over to the next chunk.
+ * GPT-2 pre-tokens can span spaces, so in that mode the chunks are cut at
+ * newlines only and whole lines are carried instead.
+ * max_words bounds the unique words held in memory before spilling to disk;
+ * 0 keeps everything in memory.
+ */
+WordCounts* count_words_streaming(TextFile* file, size_t chunk_size, size_t max_words, PretokenizerMode mode){
+	if(file == NULL || chunk_size == 0){
+		return NULL;
+	}
+	if(open_text_file(file, "r") == -1){
+		fprintf(stderr,"error opening textfile.\n");
+		return NULL;
+	}
+	WordStream stream = { .counts = create_word_counts(max_words ? max_words : 1024), .max_words = max_words };
+	char* carry = NULL;        // Start of a word cut by the previous chunk
+	size_t carry_length = 0, carry_capacity = 0;
+	int result = stream.counts ? 0 : -1;
+	int bytes = 0;
+
+	while(result == 0 && (bytes = read_next_chunk(file, chunk_size)) > 0){
+		char* chunk = file->buffer;
+		size_t start = 0;
+		for(size_t i = 0; i < (size_t)bytes && result == 0; i++){
+			if(chunk[i] != '\n' && (chunk[i] != ' ' || mode == PRETOKENIZE_GPT2)){
+				continue;
+			}
+			chunk[i] = '\0';
+			if(carry_length > 0){
+				size_t length = i - start;
+				if(carry_length + length + 1 > carry_capacity){
+					carry_capacity = carry_length + length + 1;
+					char* tmp = realloc(carry, carry_capacity);
+					if(!tmp){ result = -1; break; }
+					carry = tmp;
+				}
+				memcpy(carry + carry_length, chunk + start, length + 1);
+				result = stream_add_text(&stream, carry, mode);
+				carry_length = 0;
+			}else if(i > start){
+				result = stream_add_text(&stream, chunk + start, mode);
+			}
+			start = i + 1;
+		}
+		if(result == 0 && start < (size_t)bytes){
+			size_t length = (size_t)bytes - start;
+			if(carry_length + length + 1 > carry_capacity){
+				carry_capacity = 2 * (carry_length + length + 1);
+				char* tmp = realloc(carry, carry_capacity);
+				if(!tmp){ result = -1; break; }
+				carry = tmp;
+			}
+			memcpy(carry + carry_length, chunk + start, length);
+			carry_length += length;
+			carry[carry_length] = '\0';
+		}
+	}
+	// -1 is a read error or a failed buffer allocation, not the end of the
+	// file, and the counts so far are only part of it.
+	if(result == 0 && bytes == -1){
+		fprintf(stderr, "Error: Could not read %s.\n", file->filepath);
+		result = -1;
+	}
+	if(result == 0 && carry_length > 0){
+		result = stream_add_text(&stream, carry, mode);
+	}
+	free(carry);
+	close_text_file(file);
+
+	WordCounts* counts = NULL;
+	if(result == 0 && stream.num_runs == 0){
+		counts = stream.counts;
+		stream.counts = NULL;
+	}else if(result == 0){
+		if(stream.counts->num_words > 0){
+			result = stream_spill(&stream);
+		}
+		if(result == 0){
+			counts = merge_word_runs(stream.runs, stream.num_runs);
+		}
+	}
+	if(result != 0){
+		fprintf(stderr, "Error: Failed to count words\n");
+	}
+	for(size_t r = 0; r < stream.num_runs; r++){
+		fclose(stream.runs[r]);
+	}
+	free(stream.runs);
+	free_word_counts(stream.counts);
+	return counts;
+}
+
+// Code to implement BPE
+//
+
+/*
+ * Checkpoints. A checkpoint holds everything BPE_from_sequence needs to go
+ * on: the training mode (byte_level and pretokenizer, which decide the
+ * vocabulary layout and the separator), the vocabulary (slot, text and
+ * frequency of every token, in token_map order), the merge list and the
+ * working sequence. Pair counts are not
+ * saved; they are recounted from the sequence on resume. Numbers are written
+ * in native byte order, so checkpoints are meant to be resumed on the same
+ * kind of machine.
+ */
+#define CHECKPOINT_MAGIC "BPECKPT3"
+
+static int write_all(FILE* file, const void* data, size_t size, size_t count){
+	return fwrite(data, size, count, file) == count ? 0 : -1;
+}
+
+static int read_all(FILE* file, void* data, size_t size, size_t count){
+	return fread(data, size, count, file) == count ? 0 : -1;
+}
+
+// Checkpoints are written to path.tmp and renamed, so a crash while saving
+// leaves the previous checkpoint intact.
+int save_checkpoint(const Tokenizer* tokenizer, const TokenSequence* sequence, const char* path){
+	if(tokenizer == NULL || sequence == NULL || path == NULL){
+		return -1;
+	}
+	size_t path_length = strlen(path);
+	char* tmp_path = malloc(path_length + 5);
+	if(!tmp_path){
+		return -1;
+	}
+	memcpy(tmp_path, path, path_length);
+	memcpy(tmp_path + path_length, ".tmp", 5);
+	FILE* file = fopen(tmp_path, "wb");
+	if(!file){
+		fprintf(stderr, "Error: Could not open checkpoint %s for writing.\n", tmp_path);
+		free(tmp_path);
+		return -1;
+	}
+
+	int result = write_all(file, CHECKPOINT_MAGIC, 1, 8);
+	HashTable* token_map = tokenizer->token_map;
+	uint32_t byte_level = tokenizer->byte_level;
+	uint32_t pretokenizer = tokenizer->pretokenizer;
+	if(result == 0) result = write_all(file, &tokenizer->max_vocab_size, sizeof(size_t), 1);
+	if(result == 0) result = write_all(file, &byte_level, sizeof(uint32_t), 1);
+	if(result == 0) result = write_all(file, &pretokenizer, sizeof(uint32_t), 1);
+	if(result == 0) result = write_all(file, &token_map->size, sizeof(size_t), 1);
+	for(size_t i = 0; i < token_map->size && result == 0; i++){
+		size_t slot = *(size_t*)token_map->entries[i]->value;
+		Token* token = tokenizer->vocabulary[slot];
+		result = write_all(file, &slot, sizeof(size_t), 1);
+		if(result == 0) result = write_all(file, &token->length, sizeof(size_t), 1);
+		if(result == 0) result = write_all(file, token->text, 1, token->length);
+		if(result == 0) result = write_all(file, &token->frequency, sizeof(size_t), 1);
+	}
+	if(result == 0) result = write_all(file, &tokenizer->num_merges, sizeof(size_t), 1);
+	// Field by field, so the padding of BPEMerge is not written.
+	for(size_t i = 0; i < tokenizer->num_merges && result == 0; i++){
+		const BPEMerge* merge = &tokenizer->merges[i];
+		result = write_all(file, &merge->left, sizeof(uint32_t), 1);
+		if(result == 0) result = write_all(file, &merge->right, sizeof(uint32_t), 1);
+		if(result == 0) result = write_all(file, &merge->merged, sizeof(uint32_t), 1);
+		if(result == 0) result = write_all(file, &merge->frequency, sizeof(size_t), 1);
+	}
+	if(result == 0) result = write_all(file, &sequence->size, sizeof(size_t), 1);
+	if(result == 0) result = write_all(file, &sequence->live, sizeof(size_t), 1);
+	if(result == 0) result = write_all(file, sequence->ids, sizeof(uint32_t), sequence->size);
+	if(result == 0) result = write_all(file, sequence->weights, sizeof(size_t), sequence->size);
+	if(result == 0) result = write_all(file, sequence->prev, sizeof(size_t), sequence->size);
+	if(result == 0) result = write_all(file, sequence->next, sizeof(size_t), sequence->size);
+
+	if(fclose(file) != 0) result = -1;
+	if(result == 0 && rename(tmp_path, path) != 0) result = -1;
+	if(result != 0){
+		fprintf(stderr, "Error: Could not write checkpoint %s.\n", path);
+		remove(tmp_path);
+	}
+	free(tmp_path);
+	return result;
+}
+
+// Whether id is the slot of a token restored from the checkpoint.
+static bool is_loaded_token(const Tokenizer* tokenizer, uint32_t id){
+	return id < tokenizer->max_vocab_size && tokenizer->vocabulary[id] != NULL;
+}
+
+/*
+ * Restores the vocabulary and merges of a checkpoint into tokenizer, which
+ * must be new and have the same max_vocab_size as the saved one, since token
+ * ids are vocabulary slots. Returns the working sequence, or NULL on error.
+ */
+TokenSequence* load_checkpoint(Tokenizer* tokenizer, const char* path){
+	if(tokenizer == NULL || path == NULL){
+		return NULL;
+	}
+	if(tokenizer->vocab_size != 0 || tokenizer->num_merges != 0){
+		fprintf(stderr, "Error: Checkpoints can only be loaded into an empty tokenizer.\n");
+		return NULL;
+	}
+	FILE* file = fopen(path, "rb");
+	if(!file){
+		fprintf(stderr, "Error: Could not open checkpoint %s.\n", path);
+		return NULL;
+	}
+	// Lengths and counts are checked against what is left of the file
+	// before anything is allocated for them.
+	size_t file_size = 0;
+	if(fseek(file, 0, SEEK_END) == 0){
+		long end = ftell(file);
+		file_size = end > 0 ? (size_t)end : 0;
+	}
+	rewind(file);
+	char magic[8];
+	size_t max_vocab_size = 0, num_tokens = 0, num_merges = 0, size = 0, live = 0;
+	TokenSequence* sequence = NULL;
+	char* text = NULL;
+	int result = read_all(file, magic, 1, 8);
+	if(result == 0 && memcmp(magic, CHECKPOINT_MAGIC, 8) != 0) result = -1;
+	if(result == 0) result = read_all(file, &max_vocab_size, sizeof(size_t), 1);
+	if(result == 0 && max_vocab_size != tokenizer->max_vocab_size){
+		fprintf(stderr, "Error: Checkpoint was written with max_vocab_size %zu, tokenizer has %zu.\n", max_vocab_size, tokenizer->max_vocab_size);
+		result = -1;
+	}
+	// The mode the checkpoint was trained in wins over the tokenizer's.
+	uint32_t byte_level = 0, pretokenizer = 0;
+	if(result == 0) result = read_all(file, &byte_level, sizeof(uint32_t), 1);
+	if(result == 0) result = read_all(file, &pretokenizer, sizeof(uint32_t), 1);
+	if(result == 0 && (byte_level > 1 || pretokenizer > PRETOKENIZE_GPT2)) result = -1;
+	if(result == 0){
+		tokenizer->byte_level = byte_level;
+		tokenizer->pretokenizer = (PretokenizerMode)pretokenizer;
+	}
+	if(result == 0) result = read_all(file, &num_tokens, sizeof(size_t), 1);
+	for(size_t i = 0; i < num_tokens && result == 0; i++){
+		size_t slot, length, frequency;
+		result = read_all(file, &slot, sizeof(size_t), 1);
+		if(result == 0) result = read_all(file, &length, sizeof(size_t), 1);
+		if(result == 0 && (slot >= max_vocab_size || tokenizer->vocabulary[slot] != NULL)) result = -1;
+		if(result == 0 && length > file_size - (size_t)ftell(file)) result = -1;
+		if(result == 0 && (text = malloc(length + 1)) == NULL) result = -1;
+		if(result == 0) result = read_all(file, text, 1, length);
+		if(result == 0) result = read_all(file, &frequency, sizeof(size_t), 1);
+		if(result == 0){
+			text[length] = '\0';
+			tokenizer->vocabulary[slot] = create_token_with_frequency(text, frequency);
+			// Slots are unique (checked above) and so are the saved texts,
+			// so there is no existing entry to look for.
+			if(tokenizer->vocabulary[slot] == NULL || append_to_token_map(tokenizer->token_map, text, slot) != 0){
+				result = -1;
+			}else{
+				tokenizer->vocabulary[slot]->length = length;
+				tokenizer->vocab_size++;
+			}
+		}
+		free(text);
+		text = NULL;
+	}
+	if(result == 0) result = read_all(file, &num_merges, sizeof(size_t), 1);
+	for(size_t i = 0; i < num_merges && result == 0; i++){
+		BPEMerge merge;
+		result = read_all(file, &merge.left, sizeof(uint32_t), 1);
+		if(result == 0) result = read_all(file, &merge.right, sizeof(uint32_t), 1);
+		if(result == 0) result = read_all(file, &merge.merged, sizeof(uint32_t), 1);
+		if(result == 0) result = read_all(file, &merge.frequency, sizeof(size_t), 1);
+		if(result == 0 && (!is_loaded_token(tokenizer, merge.left) || !is_loaded_token(tokenizer, merge.right) ||
+			!is_loaded_token(tokenizer, merge.merged))){
+			result = -1;
+		}
+		if(result == 0) result = add_merge(tokenizer, merge.left, merge.right, merge.merged, merge.frequency);
+	}
+	if(result == 0) result = read_all(file, &size, sizeof(size_t), 1);
+	if(result == 0) result = read_all(file, &live, sizeof(size_t), 1);
+	size_t entry_size = sizeof(uint32_t) + 3 * sizeof(size_t);
+	if(result == 0 && (live > size || size > (file_size - (size_t)ftell(file)) / entry_size)) result = -1;
+	if(result == 0 && (sequence = create_token_sequence(size)) == NULL) result = -1;
+	if(result == 0) result = read_all(file, sequence->ids, sizeof(uint32_t), size);
+	if(result == 0) result = read_all(file, sequence->weights, sizeof(size_t), size);
+	if(result == 0) result = read_all(file, sequence->prev, sizeof(size_t), size);
+	if(result == 0) result = read_all(file, sequence->next, sizeof(size_t), size);
+	// next is the last section.
+	if(result == 0 && fgetc(file) != EOF) result = -1;
+	for(size_t i = 0; i < size && result == 0; i++){
+		if((sequence->ids[i] != NO_TOKEN && !is_loaded_token(tokenizer, sequence->ids[i])) ||
+			(sequence->prev[i] != NO_POSITION && sequence->prev[i] >= size) ||
+			(sequence->next[i] != NO_POSITION && sequence->next[i] >= size)){
+			result = -1;
+		}
+	}
+	fclose(file);
+
+	if(result != 0){
+		fprintf(stderr, "Error: Could not read checkpoint %s.\n", path);
+		free_token_sequence(sequence);
+		return NULL;
+	}
+	sequence->size = size;
+	sequence->live = live;
+	return sequence;
+}
+
+// Continues a training run from the checkpoint at path. Checkpointing stays
+// as configured on tokenizer, so the resumed run keeps saving its progress.
+int BPE_resume(Tokenizer* tokenizer, const char* path){
+	TokenSequence* sequence = load_checkpoint(tokenizer, path);
+	if(sequence == NULL){
+		return -1;
+	}
+	printf("Resuming from %s after %zu merges\n", path, tokenizer->num_merges);
+	BPE_from_sequence(tokenizer, sequence);
+	free_token_sequence(sequence);
+	return 0;
+}
+
+// Saves a checkpoint every checkpoint_every merges or checkpoint_interval
+// seconds, whichever comes first. 0 disables each trigger.
+int set_checkpointing(Tokenizer* tokenizer, const char* path, size_t every_merges, double every_seconds){
+	if(tokenizer == NULL){
+		return -1;
+	}
+	char* copy = NULL;
+	if(path != NULL && (copy = strdup(path)) == NULL){
+		return -1;
+	}
+	free(tokenizer->checkpoint_path);
+	tokenizer->checkpoint_path = copy;
+	tokenizer->checkpoint_every = every_merges;
+	tokenizer->checkpoint_interval = every_seconds;
+	return 0;
+}
+
+// Learns one merge from the most frequent pair and applies it to sequence.
+// Returns 1, or 0 when there is nothing left to merge.
+static size_t apply_single_merge(Tokenizer* tokenizer, TokenSequence* sequence){
+	if(!tokenizer->incremental_pairs){
 		DEBUG_TOK("Counting pairs...\n");
-		count_pairs(tokenizer,tokenized_data,num_tokens);
-		HashEntry* most_freq_pair = find_most_freq_pairs(tokenizer->pair_freqs);
-		if(most_freq_pair == NULL){
-			break; // no more frequent pairs left.
-		}
-		DEBUG_TOK("Most frequent pair: %s freq: %zu\n", (const char*)most_freq_pair->key, *(size_t*)most_freq_pair->value);
-		char* res  = merge_most_freq_pair(tokenized_data, most_freq_pair,&num_tokens);
-		if(res == NULL){
+		count_pairs(tokenizer, sequence);
+	}
+	HashEntry* most_freq_pair = tokenizer->incremental_pairs
+		? pop_most_freq_pair(tokenizer)
+		: find_most_freq_pairs(tokenizer->pair_freqs);
+	if(most_freq_pair == NULL){
+		return 0; // no more frequent pairs left.
+	}
+	size_t pair_freq = *(size_t*)most_freq_pair->value;
+	uint64_t key = *(const uint64_t*)most_freq_pair->key;
+	uint32_t left = pair_key_left(key);
+	uint32_t right = pair_key_right(key);
+
+	Token* merged_token = merge_tokens(tokenizer->vocabulary[left], tokenizer->vocabulary[right]);
+	if(merged_token == NULL){
+		DEBUG_MEM("Error: Failed to merged most frequent pair tokens");
+		return 0;
+	}
+	DEBUG_TOK("Most frequent pair: %s + %s freq: %zu\n", tokenizer->vocabulary[left]->text, tokenizer->vocabulary[right]->text, pair_freq);
+	size_t merged = add_merged_token(tokenizer, merged_token->text, pair_freq);
+	free_token(merged_token);
+	if(merged == NO_POSITION){
+		printf("Vocabulary is full, stopping after %zu merges\n", tokenizer->num_merges);
+		return 0;
+	}
+	add_merge(tokenizer, left, right, (uint32_t)merged, pair_freq);
+
+	if(tokenizer->incremental_pairs){
+		merge_most_freq_pair_incremental(tokenizer, sequence, most_freq_pair, (uint32_t)merged);
+	}else{
+		merge_most_freq_pair(sequence, most_freq_pair, (uint32_t)merged);
+	}
+	return 1;
+}
+
+// Pair order used to select merges: higher count first, then smaller key.
+static bool pair_entry_before(const HashEntry* a, const HashEntry* b){
+	size_t freq_a = *(const size_t*)a->value;
+	size_t freq_b = *(const size_t*)b->value;
+	return freq_a > freq_b || (freq_a == freq_b && uint64_compare(a->key, b->key) < 0);
+}
+
+// Fills top with the limit best pairs of pair_freqs in selection order and
+// returns how many were found.
+static size_t find_top_pairs(HashTable* pair_freqs, HashEntry** top, size_t limit){
+	size_t found = 0;
+	for(size_t i = 0; i < pair_freqs->capacity; i++){
+		HashEntry* entry = pair_freqs->entries[i];
+		if(!entry || !entry->is_occupied || *(size_t*)entry->value == 0){
+			continue;
+		}
+		if(found == limit && !pair_entry_before(entry, top[limit - 1])){
+			continue;
+		}
+		size_t at = found < limit ? found++ : limit - 1;
+		while(at > 0 && pair_entry_before(entry, top[at - 1])){
+			top[at] = top[at - 1];
+			at--;
+		}
+		top[at] = entry;
+	}
+	return found;
+}
+
+/*
+ * Learns up to tokenizer->merges_per_pass merges from one pair count and
+ * applies them in a single sweep of the sequence. Used by the full recount
+ * path only. The batch is the longest run of best pairs that share no token
+ * with each other, and it gives the same merges as one at a time:
+ *   - A merge only lowers counts of pairs sharing a token with it, so the
+ *     other pairs of the batch keep their counts.
+ *   - New pairs count at most as much as a pair left out of the batch, so
+ *     pairs whose count is not strictly above every left-out pair are
+ *     dropped. When the gap is that small the pass falls back to one merge.
+ *   - A merge that yields a token already in the vocabulary adds to the
+ *     counts of old pairs, so the batch ends with it.
+ * Returns the number of merges applied, 0 when there is nothing to merge.
+ */
+static size_t apply_merge_batch(Tokenizer* tokenizer, TokenSequence* sequence){
+	size_t limit = tokenizer->merges_per_pass;
+	HashEntry** top = malloc((limit + 1) * sizeof(HashEntry*));
+	uint32_t* batch_of_left = malloc(tokenizer->max_vocab_size * sizeof(uint32_t));
+	bool* in_batch = calloc(tokenizer->max_vocab_size, sizeof(bool));
+	if(!top || !batch_of_left || !in_batch){
+		free(top);
+		free(batch_of_left);
+		free(in_batch);
+		return apply_single_merge(tokenizer, sequence);
+	}
+	count_pairs(tokenizer, sequence);
+	size_t found = find_top_pairs(tokenizer->pair_freqs, top, limit + 1);
+
+	// Longest prefix of token-disjoint pairs.
+	size_t size = 0;
+	while(size < found && size < limit){
+		uint64_t key = *(const uint64_t*)top[size]->key;
+		uint32_t left = pair_key_left(key), right = pair_key_right(key);
+		if(in_batch[left] || in_batch[right]){
+			break;
+		}
+		in_batch[left] = in_batch[right] = true;
+		size++;
+	}
+	if(size < found){
+		size_t cutoff = *(size_t*)top[size]->value;
+		while(size > 1 && *(size_t*)top[size - 1]->value <= cutoff){
+			size--;  // a single merge is always safe
+		}
+	}
+
+	size_t applied = 0;
+	for(size_t b = 0; b < size; b++){
+		uint64_t key = *(const uint64_t*)top[b]->key;
+		uint32_t left = pair_key_left(key), right = pair_key_right(key);
+		size_t pair_freq = *(size_t*)top[b]->value;
+		Token* merged_token = merge_tokens(tokenizer->vocabulary[left], tokenizer->vocabulary[right]);
+		if(merged_token == NULL){
 			DEBUG_MEM("Error: Failed to merged most frequent pair tokens");
-			free_tokens(tokenized_data,num_tokens);
-			return;
+			break;
+		}
+		size_t vocab_size = tokenizer->vocab_size;
+		size_t merged = add_merged_token(tokenizer, merged_token->text, pair_freq);
+		free_token(merged_token);
+		if(merged == NO_POSITION){
+			printf("Vocabulary is full, stopping after %zu merges\n", tokenizer->num_merges);
+			break;
+		}
+		add_merge(tokenizer, left, right, (uint32_t)merged, pair_freq);
+		batch_of_left[left] = (uint32_t)applied;  // lefts of the batch are distinct
+		applied++;
+		if(tokenizer->vocab_size == vocab_size){
+			break; // existing token, see above
 		}
+	}
 
-		DEBUG_TOK("Vocabulary size before add_merged_token: %zu\n", tokenizer->vocab_size);
-		add_merged_token(tokenizer,(const char*) res, *(size_t*)most_freq_pair->value);
-		DEBUG_TOK("VOcabulary size after add_merged_token: %zu and num_tokens is %zu \n",tokenizer->vocab_size,num_tokens);
-		free(res);
+	// One sweep applies every merge of the batch. Merged slots are never
+	// looked at again, exactly as with merge_most_freq_pair.
+	const BPEMerge* batch = tokenizer->merges + tokenizer->num_merges - applied;
+	memset(in_batch, 0, tokenizer->max_vocab_size * sizeof(bool));
+	for(size_t b = 0; b < applied; b++){
+		in_batch[batch[b].left] = true;
+	}
+	for(size_t i = 0; i < sequence->size; i++){
+		size_t next = sequence->next[i];
+		uint32_t id = sequence->ids[i];
+		if(next == NO_POSITION || !in_batch[id]){
+			continue;
+		}
+		const BPEMerge* merge = &batch[batch_of_left[id]];
+		if(sequence->ids[next] == merge->right){
+			merge_sequence_tokens(sequence, i, merge->merged);
+		}
+	}
+	if(sequence->live < sequence->size / 2){
+		compact_token_sequence(sequence, NULL);
+	}
+	DEBUG_TOK("Applied %zu merges in one pass\n", applied);
+	free(top);
+	free(batch_of_left);
+	free(in_batch);
+	return applied;
+}
 
-		if(merges % 1000 == 0) {  // Print every 1000 merges
+/*
+ * Runs the BPE merge loop over an id sequence whose tokens are already in the
+ * vocabulary. Each iteration picks the most frequent pair, adds the merged
+ * token to the vocabulary, records the merge and rewrites the sequence.
+ */
+void BPE_from_sequence(Tokenizer* tokenizer, TokenSequence* sequence){
+	if(tokenizer == NULL || sequence == NULL){
+		fprintf(stderr,"Tokenizer or sequence is NULL\n");
+		return;
+	}
+	// A resumed run picks up the merge count where the checkpoint left it.
+	size_t merges = tokenizer->num_merges;
+	size_t counter = tokenizer->num_merges;
+	size_t last_checkpoint = merges;
+	time_t last_checkpoint_time = time(NULL);
+	if(tokenizer->incremental_pairs){
+		// Count once; every merge below keeps pair_freqs and pair_queue up to date.
+		count_pairs(tokenizer, sequence);
+		rebuild_pair_queue(tokenizer);
+	}
+	while(tokenizer->vocab_size < MAX_VOCAB_SIZE || counter < 2*MAX_VOCAB_SIZE){
+		size_t applied = (!tokenizer->incremental_pairs && tokenizer->merges_per_pass > 1)
+			? apply_merge_batch(tokenizer, sequence)
+			: apply_single_merge(tokenizer, sequence);
+		if(applied == 0){
+			break;
+		}
+		DEBUG_TOK("Vocabulary size: %zu and num_tokens is %zu \n",tokenizer->vocab_size,sequence->live);
+
+		if(merges % 1000 == 0 || merges % 1000 + applied > 1000) {  // Print every 1000 merges
             		printf("Completed %zu merges, vocabulary size: %zu\n",
                 	   merges, tokenizer->vocab_size);
         	}
 
 		DEBUG_TOK("Iteration %zu: vocab_size=%zu, MAX_VOCAB_SIZE=%i\n",counter, tokenizer->vocab_size, MAX_VOCAB_SIZE);
-        	merges++;
-		counter++;
+        	merges += applied;
+		counter += applied;
+
+		if(tokenizer->checkpoint_path){
+			bool due = tokenizer->checkpoint_every > 0 && merges - last_checkpoint >= tokenizer->checkpoint_every;
+			if(!due && tokenizer->checkpoint_interval > 0){
+				due = difftime(time(NULL), last_checkpoint_time) >= tokenizer->checkpoint_interval;
+			}
+			if(due){
+				if(save_checkpoint(tokenizer, sequence, tokenizer->checkpoint_path) == 0){
+					DEBUG_TOK("Checkpoint saved after %zu merges\n", merges);
+				}
+				last_checkpoint = merges;
+				last_checkpoint_time = time(NULL);
+			}
+		}
 	}
 	printf("BPE complete. Final vocabulary size: %zu\n", tokenizer->vocab_size);
+}
+
+// Trains on unique words with their counts. words is left to the caller.
+static void BPE_from_word_counts(Tokenizer* tokenizer, const WordCounts* words){
+	if(words == NULL || words->num_words == 0){
+		fprintf(stderr,"Error: Could not tokenize dataset or zero token\n");
+		return;
+	}
+	DEBUG_TOK("\nUnique words: %zu of %zu\n", words->num_words, words->total);
+	TokenSequence* sequence = words_to_sequence(tokenizer, words);
+	if(sequence == NULL){
+		fprintf(stderr,"Error: Could not build the token id sequence\n");
+		return;
+	}
+	BPE_from_sequence(tokenizer, sequence);
+	free_token_sequence(sequence);
+}
+
+typedef struct {
+	TextFile** files;
+	WordCounts** counts;      // One result per file, NULL on failure
+	PretokenizerMode mode;
+} DatasetCountJob;
+
+static void count_file_words(void* context, size_t index){
+	DatasetCountJob* job = (DatasetCountJob*)context;
+	job->counts[index] = count_words(job->files[index], job->mode);
+}
+
+/*
+ * Reads every file of the dataset on the tokenizer's thread pool and returns
+ * the unique words of the whole dataset. Each file is counted on its own and
+ * the results are merged in dataset order, so the outcome does not depend on
+ * the number of threads. Files that cannot be read are reported and skipped.
+ */
+WordCounts* count_dataset_words(Tokenizer* tokenizer, Dataset* dataset){
+	if(tokenizer == NULL || dataset == NULL){
+		return NULL;
+	}
+	size_t num_files = 0;
+	for(size_t c = 0; c < dataset->num_categories; c++){
+		num_files += dataset->categories[c]->num_files;
+	}
+	WordCounts* total = create_word_counts(1024);
+	if(!total || num_files == 0){
+		return total;
+	}
+
+	DatasetCountJob job;
+	job.mode = tokenizer->pretokenizer;
+	job.files = malloc(num_files * sizeof(TextFile*));
+	job.counts = calloc(num_files, sizeof(WordCounts*));
+	ThreadPool* pool = get_thread_pool(tokenizer);
+	if(!job.files || !job.counts || !pool){
+		fprintf(stderr, "Error: Could not set up dataset word count.\n");
+		free(job.files);
+		free(job.counts);
+		free_word_counts(total);
+		return NULL;
+	}
+	size_t index = 0;
+	for(size_t c = 0; c < dataset->num_categories; c++){
+		Category* category = dataset->categories[c];
+		for(size_t f = 0; f < category->num_files; f++){
+			job.files[index++] = category->files[f];
+		}
+	}
+
+	run_thread_pool(pool, num_files, count_file_words, &job);
+
+	int result = 0;
+	for(size_t i = 0; i < num_files; i++){
+		WordCounts* counts = job.counts[i];
+		if(counts == NULL){
+			fprintf(stderr, "Error: Could not read %s, skipping it.\n", job.files[i]->filepath);
+			continue;
+		}
+		for(size_t w = 0; w < counts->num_words && result == 0; w++){
+			result = add_word_count(total, counts->words[w], counts->counts[w]);
+		}
+		free_word_counts(counts);
+	}
+	free(job.files);
+	free(job.counts);
+	if(result != 0){
+		fprintf(stderr, "Error: Failed to merge dataset word counts\n");
+		free_word_counts(total);
+		return NULL;
+	}
+	return total;
+}
+
+// Trains one vocabulary over every file of a dataset. Files are read and
+// split into words in parallel using tokenizer->num_threads threads.
+void BPE_from_dataset(Tokenizer* tokenizer, Dataset* dataset){
+	if(tokenizer == NULL || dataset == NULL){
+		fprintf(stderr,"Tokenizer or dataset is empty or NULL\n");
+		return;
+	}
+	WordCounts* words = count_dataset_words(tokenizer, dataset);
+	BPE_from_word_counts(tokenizer, words);
+	free_word_counts(words);
+}
+
+// Trains on a file of any size using count_words_streaming. Memory is bound
+// by the vocabulary and the unique words instead of the corpus size.
+void BPE_streaming(Tokenizer* tokenizer, TextFile* dataset){
+	if(tokenizer == NULL || dataset == NULL){
+		fprintf(stderr,"Tokenizer or dataset is empty or NULL\n");
+		return;
+	}
+	WordCounts* words = count_words_streaming(dataset, tokenizer->stream_chunk_size, tokenizer->max_words_in_memory, tokenizer->pretokenizer);
+	BPE_from_word_counts(tokenizer, words);
+	free_word_counts(words);
+}
+
+void BPE(Tokenizer* tokenizer, TextFile* dataset){
+	// Null check to avoid uneccessary seg fault.
+	if(tokenizer == NULL || dataset ==NULL){
+		fprintf(stderr,"Tokenizer or dataset is empty or NULL\n");
+		return;
+	}
+	if(tokenizer->deduplicate_words){
+		// Step 1: collapse the corpus into unique words with counts
+		WordCounts* words = count_words(dataset, tokenizer->pretokenizer);
+		BPE_from_word_counts(tokenizer, words);
+		free_word_counts(words);
+		return;
+	}
+
+	if(tokenizer->byte_level){
+		// One pass straight into byte ids; the base alphabet is fixed.
+		TokenSequence* sequence = file_to_byte_sequence(tokenizer, dataset);
+		if(sequence == NULL || sequence->size == 0){
+			fprintf(stderr,"Error: Could not tokenize dataset or zero token\n");
+			free_token_sequence(sequence);
+			return;
+		}
+		BPE_from_sequence(tokenizer, sequence);
+		free_token_sequence(sequence);
+		return;
+	}
+
+	// Step 1: tokenized the dataset by characters
+	size_t num_tokens = 0;
+	Token** tokenized_data = tokenize_with_mode(dataset,"",tokenizer->pretokenizer,&num_tokens);
+	if(tokenized_data == NULL || num_tokens == 0){
+		fprintf(stderr,"Error: Could not tokenize dataset or zero token\n");
+		return;
+	}
+	
+	//printf("Starting BPE with %zu lines of text\n", dataset->num_lines);
+    	DEBUG_TOK("\nInitial tokens: %zu\n", num_tokens);
+	
+	// Initialize the vocabulary to include tokens consisting of individual characters
+	DEBUG_TOK("Initializing Vocabulary...");
+
+	initialize_vocabulary(tokenizer,dataset);
+	DEBUG_TOK("Vocabulary initialized.");
+
+	// Step 2: train on token ids; the strings are only needed in the vocabulary.
+	TokenSequence* sequence = tokens_to_sequence(tokenizer, tokenized_data, num_tokens);
 	free_tokens(tokenized_data,num_tokens);
+	if(sequence == NULL){
+		fprintf(stderr,"Error: Could not build the token id sequence\n");
+		return;
+	}
+	BPE_from_sequence(tokenizer, sequence);
+	free_token_sequence(sequence);
 }
@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <utf8.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * utf8.c
+ *
+ * UTF-8 segmentation for the character level tokenizer. Text is mostly ASCII,
+ * so the hot path is utf8_ascii_run, which checks 32 (AVX2) or 16 (SSE2)
+ * bytes at a time with one movemask of their high bits. Multi-byte
+ * characters go through the scalar decoder below.
+ */
+
+size_t utf8_ascii_run(const char* text, size_t length){
+	size_t i = 0;
+#if defined(__AVX2__)
+	for(; i + 32 <= length; i += 32){
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)(text + i));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(chunk);
+		if(mask != 0){
+			return i + (size_t)__builtin_ctz(mask);
+		}
+	}
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+	for(; i + 16 <= length; i += 16){
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(text + i));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(chunk);
+		if(mask != 0){
+			return i + (size_t)__builtin_ctz(mask);
+		}
+	}
+#endif
+	while(i < length && ((unsigned char)text[i] & 0x80) == 0){
+		i++;
+	}
+	return i;
+}
+
+size_t utf8_char_length(const char* text, size_t length){
+	if(length == 0){
+		return 0;
+	}
+	const unsigned char* s = (const unsigned char*)text;
+	unsigned char lead = s[0];
+	if(lead < 0x80){
+		return 1;
+	}
+	size_t needed;
+	// Bounds of the second byte; they exclude overlong forms, surrogates
+	// and code points above U+10FFFF.
+	unsigned char low = 0x80, high = 0xBF;
+	if(lead >= 0xC2 && lead <= 0xDF){
+		needed = 2;
+	}else if(lead >= 0xE0 && lead <= 0xEF){
+		needed = 3;
+		if(lead == 0xE0) low = 0xA0;
+		if(lead == 0xED) high = 0x9F;
+	}else if(lead >= 0xF0 && lead <= 0xF4){
+		needed = 4;
+		if(lead == 0xF0) low = 0x90;
+		if(lead == 0xF4) high = 0x8F;
+	}else{
+		return 0; // continuation byte, C0, C1 or F5..FF
+	}
+	if(length < needed || s[1] < low || s[1] > high){
+		return 0;
+	}
+	for(size_t i = 2; i < needed; i++){
+		if((s[i] & 0xC0) != 0x80){
+			return 0;
+		}
+	}
+	return needed;
+}
+
+bool utf8_validate(const char* text, size_t length, size_t* error_offset){
+	size_t i = 0;
+	while(i < length){
+		i += utf8_ascii_run(text + i, length - i);
+		if(i >= length){
+			break;
+		}
+		size_t char_length = utf8_char_length(text + i, length - i);
+		if(char_length == 0){
+			if(error_offset) *error_offset = i;
+			return false;
+		}
+		i += char_length;
+	}
+	return true;
+}
+
+size_t utf8_count_invalid(const char* text, size_t length){
+	size_t invalid = 0;
+	size_t i = 0;
+	while(i < length){
+		i += utf8_ascii_run(text + i, length - i);
+		if(i >= length){
+			break;
+		}
+		size_t char_length = utf8_char_length(text + i, length - i);
+		if(char_length == 0){
+			invalid++;
+			char_length = 1;
+		}
+		i += char_length;
+	}
+	return invalid;
+}
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <word_cache.h>
+#include <hash_table.h>
+
+/*
+ * word_cache.c
+ *
+ * Sharded LRU cache of encoded words. The generic HashTable cannot remove
+ * keys, which eviction needs, so each shard keeps its entries in a slab with
+ * index based hash chains and LRU links. Evicting an entry unlinks it from
+ * both lists and puts its slot on the free list.
+ */
+
+#define WORD_CACHE_SEED 0x9747b28c
+#define WORD_CACHE_INITIAL_BUCKETS 64
+
+static size_t entry_bytes(size_t length, size_t num_ids){
+	return sizeof(WordCacheEntry) + sizeof(size_t) + length + num_ids * sizeof(uint32_t);
+}
+
+static size_t bucket_of(const WordCacheShard* shard, uint32_t hash, size_t num_shards){
+	return (hash / num_shards) & (shard->num_buckets - 1);
+}
+
+static int init_shard(WordCacheShard* shard, size_t max_bytes){
+	memset(shard, 0, sizeof(WordCacheShard));
+	shard->num_buckets = WORD_CACHE_INITIAL_BUCKETS;
+	shard->buckets = malloc(shard->num_buckets * sizeof(size_t));
+	if(!shard->buckets){
+		return -1;
+	}
+	for(size_t b = 0; b < shard->num_buckets; b++){
+		shard->buckets[b] = WORD_CACHE_NONE;
+	}
+	shard->free_slot = WORD_CACHE_NONE;
+	shard->lru_head = shard->lru_tail = WORD_CACHE_NONE;
+	shard->max_bytes = max_bytes;
+	pthread_mutex_init(&shard->lock, NULL);
+	return 0;
+}
+
+WordCache* create_word_cache(size_t max_bytes, size_t num_shards){
+	if(num_shards == 0){
+		num_shards = 1;
+	}
+	WordCache* cache = malloc(sizeof(WordCache));
+	if(!cache){
+		fprintf(stderr, "Error: Could not allocate word cache.\n");
+		return NULL;
+	}
+	cache->shards = malloc(num_shards * sizeof(WordCacheShard));
+	if(!cache->shards){
+		fprintf(stderr, "Error: Could not allocate word cache.\n");
+		free(cache);
+		return NULL;
+	}
+	cache->num_shards = 0;
+	for(size_t s = 0; s < num_shards; s++){
+		if(init_shard(&cache->shards[s], max_bytes / num_shards) != 0){
+			fprintf(stderr, "Error: Could not allocate word cache.\n");
+			free_word_cache(cache);
+			return NULL;
+		}
+		cache->num_shards++;
+	}
+	return cache;
+}
+
+void free_word_cache(WordCache* cache){
+	if(!cache){
+		return;
+	}
+	for(size_t s = 0; s < cache->num_shards; s++){
+		WordCacheShard* shard = &cache->shards[s];
+		for(size_t e = shard->lru_head; e != WORD_CACHE_NONE; e = shard->entries[e].lru_next){
+			free(shard->entries[e].ids);
+		}
+		free(shard->entries);
+		free(shard->buckets);
+		pthread_mutex_destroy(&shard->lock);
+	}
+	free(cache->shards);
+	free(cache);
+}
+
+static void lru_unlink(WordCacheShard* shard, size_t e){
+	WordCacheEntry* entry = &shard->entries[e];
+	if(entry->lru_prev != WORD_CACHE_NONE) shard->entries[entry->lru_prev].lru_next = entry->lru_next;
+	else shard->lru_head = entry->lru_next;
+	if(entry->lru_next != WORD_CACHE_NONE) shard->entries[entry->lru_next].lru_prev = entry->lru_prev;
+	else shard->lru_tail = entry->lru_prev;
+}
+
+static void lru_push_front(WordCacheShard* shard, size_t e){
+	WordCacheEntry* entry = &shard->entries[e];
+	entry->lru_prev = WORD_CACHE_NONE;
+	entry->lru_next = shard->lru_head;
+	if(shard->lru_head != WORD_CACHE_NONE) shard->entries[shard->lru_head].lru_prev = e;
+	shard->lru_head = e;
+	if(shard->lru_tail == WORD_CACHE_NONE) shard->lru_tail = e;
+}
+
+static size_t find_entry(const WordCacheShard* shard, size_t bucket, uint32_t hash, const char* word, size_t length){
+	for(size_t e = shard->buckets[bucket]; e != WORD_CACHE_NONE; e = shard->entries[e].chain_next){
+		const WordCacheEntry* entry = &shard->entries[e];
+		if(entry->hash == hash && entry->length == length && memcmp(entry->word, word, length) == 0){
+			return e;
+		}
+	}
+	return WORD_CACHE_NONE;
+}
+
+static void evict_tail(WordCacheShard* shard, size_t num_shards){
+	size_t e = shard->lru_tail;
+	WordCacheEntry* entry = &shard->entries[e];
+	size_t* link = &shard->buckets[bucket_of(shard, entry->hash, num_shards)];
+	while(*link != e){
+		link = &shard->entries[*link].chain_next;
+	}
+	*link = entry->chain_next;
+	lru_unlink(shard, e);
+	shard->bytes -= entry_bytes(entry->length, entry->num_ids);
+	free(entry->ids);
+	entry->ids = NULL;
+	entry->chain_next = shard->free_slot;
+	shard->free_slot = e;
+	shard->num_entries--;
+	shard->evictions++;
+}
+
+// Doubles the buckets once chains average more than one entry.
+static void grow_buckets(WordCacheShard* shard, size_t num_shards){
+	size_t num_buckets = shard->num_buckets * 2;
+	size_t* buckets = malloc(num_buckets * sizeof(size_t));
+	if(!buckets){
+		return; // Longer chains are still correct
+	}
+	for(size_t b = 0; b < num_buckets; b++){
+		buckets[b] = WORD_CACHE_NONE;
+	}
+	shard->num_buckets = num_buckets;
+	for(size_t e = shard->lru_head; e != WORD_CACHE_NONE; e = shard->entries[e].lru_next){
+		size_t b = bucket_of(shard, shard->entries[e].hash, num_shards);
+		shard->entries[e].chain_next = buckets[b];
+		buckets[b] = e;
+	}
+	free(shard->buckets);
+	shard->buckets = buckets;
+}
+
+static size_t take_slot(WordCacheShard* shard){
+	if(shard->free_slot != WORD_CACHE_NONE){
+		size_t e = shard->free_slot;
+		shard->free_slot = shard->entries[e].chain_next;
+		return e;
+	}
+	if(shard->num_slots >= shard->capacity){
+		size_t capacity = shard->capacity ? shard->capacity * 2 : 64;
+		WordCacheEntry* entries = realloc(shard->entries, capacity * sizeof(WordCacheEntry));
+		if(!entries){
+			return WORD_CACHE_NONE;
+		}
+		shard->entries = entries;
+		shard->capacity = capacity;
+	}
+	return shard->num_slots++;
+}
+
+size_t word_cache_lookup(WordCache* cache, const char* word, size_t length, uint32_t* ids, size_t max_ids){
+	uint32_t hash = murmur3_32((const uint8_t*)word, length, WORD_CACHE_SEED);
+	WordCacheShard* shard = &cache->shards[hash % cache->num_shards];
+	pthread_mutex_lock(&shard->lock);
+	size_t e = find_entry(shard, bucket_of(shard, hash, cache->num_shards), hash, word, length);
+	size_t count = WORD_CACHE_MISS;
+	if(e != WORD_CACHE_NONE && shard->entries[e].num_ids <= max_ids){
+		count = shard->entries[e].num_ids;
+		memcpy(ids, shard->entries[e].ids, count * sizeof(uint32_t));
+		lru_unlink(shard, e);
+		lru_push_front(shard, e);
+		shard->hits++;
+	}else{
+		shard->misses++;
+	}
+	pthread_mutex_unlock(&shard->lock);
+	return count;
+}
+
+int word_cache_insert(WordCache* cache, const char* word, size_t length, const uint32_t* ids, size_t num_ids){
+	uint32_t hash = murmur3_32((const uint8_t*)word, length, WORD_CACHE_SEED);
+	WordCacheShard* shard = &cache->shards[hash % cache->num_shards];
+	size_t bytes = entry_bytes(length, num_ids);
+	if(bytes > shard->max_bytes){
+		return 0;
+	}
+	// Copy outside the lock; ids come first so they stay aligned.
+	uint32_t* data = malloc(num_ids * sizeof(uint32_t) + length + 1);
+	if(!data){
+		fprintf(stderr, "Error: Could not allocate word cache entry.\n");
+		return -1;
+	}
+	memcpy(data, ids, num_ids * sizeof(uint32_t));
+	char* text = (char*)(data + num_ids);
+	memcpy(text, word, length);
+	text[length] = '\0';
+
+	pthread_mutex_lock(&shard->lock);
+	if(find_entry(shard, bucket_of(shard, hash, cache->num_shards), hash, word, length) != WORD_CACHE_NONE){
+		// Another thread cached it first.
+		pthread_mutex_unlock(&shard->lock);
+		free(data);
+		return 0;
+	}
+	while(shard->bytes + bytes > shard->max_bytes){
+		evict_tail(shard, cache->num_shards);
+	}
+	size_t e = take_slot(shard);
+	if(e == WORD_CACHE_NONE){
+		pthread_mutex_unlock(&shard->lock);
+		free(data);
+		fprintf(stderr, "Error: Could not grow word cache.\n");
+		return -1;
+	}
+	if(shard->num_entries >= shard->num_buckets){
+		grow_buckets(shard, cache->num_shards);
+	}
+	WordCacheEntry* entry = &shard->entries[e];
+	entry->hash = hash;
+	entry->num_ids = (uint32_t)num_ids;
+	entry->length = length;
+	entry->ids = data;
+	entry->word = text;
+	size_t bucket = bucket_of(shard, hash, cache->num_shards);
+	entry->chain_next = shard->buckets[bucket];
+	shard->buckets[bucket] = e;
+	lru_push_front(shard, e);
+	shard->num_entries++;
+	shard->bytes += bytes;
+	pthread_mutex_unlock(&shard->lock);
+	return 0;
+}
+
+WordCacheStats word_cache_stats(WordCache* cache){
+	WordCacheStats stats = {0};
+	if(!cache){
+		return stats;
+	}
+	for(size_t s = 0; s < cache->num_shards; s++){
+		WordCacheShard* shard = &cache->shards[s];
+		pthread_mutex_lock(&shard->lock);
+		stats.hits += shard->hits;
+		stats.misses += shard->misses;
+		stats.evictions += shard->evictions;
+		stats.entries += shard->num_entries;
+		stats.bytes += shard->bytes;
+		pthread_mutex_unlock(&shard->lock);
+	}
+	return stats;
+}
@@ -78,6 +78,492 @@ void test_BPE_repeated_sequence() {
     printf("Repeated sequence test passed\n");
 }
 
+// Helper to check two trained tokenizers produced the same vocabulary.
+void assert_same_vocabulary(Tokenizer* a, Tokenizer* b) {
+    assert(a->vocab_size == b->vocab_size);
+    assert(a->max_vocab_size == b->max_vocab_size);
+    for (size_t i = 0; i < a->max_vocab_size; i++) {
+        Token* x = a->vocabulary[i];
+        Token* y = b->vocabulary[i];
+        if (x == NULL || y == NULL) {
+            assert(x == y);
+            continue;
+        }
+        assert_token_equals(y, x->text, x->frequency);
+    }
+}
+
+void assert_same_merges(Tokenizer* a, Tokenizer* b) {
+    assert(a->num_merges == b->num_merges);
+    for (size_t i = 0; i < a->num_merges; i++) {
+        assert(a->merges[i].left == b->merges[i].left);
+        assert(a->merges[i].right == b->merges[i].right);
+        assert(a->merges[i].merged == b->merges[i].merged);
+        assert(a->merges[i].frequency == b->merges[i].frequency);
+    }
+}
+
+void test_BPE_incremental_matches_full_recount() {
+    printf("Testing incremental pair counts against full recount...\n");
+    TextFile* file = create_test_file("the cat sat on the mat. aaaa banana bandana, the hat that sat");
+    Tokenizer* full = create_tokenizer(100);
+    Tokenizer* incremental = create_tokenizer(100);
+    full->incremental_pairs = false;
+    incremental->incremental_pairs = true;
+
+    BPE(full, file);
+    BPE(incremental, file);
+
+    assert(full->vocab_size > 0);
+    assert_same_vocabulary(full, incremental);
+
+    free_tokenizer(&full);
+    free_tokenizer(&incremental);
+    destroy_text_file(&file);
+    printf("Incremental pair count test passed\n");
+}
+
+void test_BPE_deduplicated_words_match_full_corpus() {
+    printf("Testing BPE on deduplicated words...\n");
+    TextFile* file = create_test_file("the cat sat on the mat. aaaa banana bandana, the hat that sat");
+    Tokenizer* corpus = create_tokenizer(100);
+    Tokenizer* words = create_tokenizer(100);
+    corpus->deduplicate_words = false;
+    words->deduplicate_words = true;
+
+    BPE(corpus, file);
+    BPE(words, file);
+
+    assert(corpus->vocab_size > 0);
+    assert(corpus->num_merges == words->num_merges);
+    assert_same_vocabulary(corpus, words);
+
+    free_tokenizer(&corpus);
+    free_tokenizer(&words);
+    destroy_text_file(&file);
+    printf("Deduplicated words test passed\n");
+}
+
+void test_count_pairs_parallel_matches_serial() {
+    printf("Testing parallel pair counting...\n");
+    Tokenizer* tokenizer = create_tokenizer(100);
+    TokenSequence* sequence = create_token_sequence(4);
+    // Words of varying length so pairs straddle every shard boundary.
+    for (size_t w = 0; w < 40; w++) {
+        for (size_t c = 0; c < 1 + w % 7; c++) {
+            append_to_token_sequence(sequence, (uint32_t)((w * 3 + c) % 5), 1 + w % 3, c > 0);
+        }
+    }
+
+    count_pairs(tokenizer, sequence);
+    HashTable* serial = tokenizer->pair_freqs;
+    tokenizer->pair_freqs = create_hash_table(INITIAL_PAIR_FREQ_SIZE);
+    create_uint64_ops(tokenizer->pair_freqs);
+    tokenizer->pair_freqs->ops.free_value = free_pair_stats;
+    tokenizer->num_threads = 3;
+    assert(count_pairs_parallel(tokenizer, sequence, 7) == 0);
+
+    assert(tokenizer->pair_freqs->size == serial->size);
+    for (size_t i = 0; i < serial->capacity; i++) {
+        HashEntry* entry = serial->entries[i];
+        if (!entry || !entry->is_occupied) continue;
+        PairStats* expected = (PairStats*)entry->value;
+        HashEntry* found = find_hash_entry(tokenizer->pair_freqs, entry->key);
+        assert(found != NULL);
+        PairStats* actual = (PairStats*)found->value;
+        assert(actual->frequency == expected->frequency);
+        assert(actual->num_positions == expected->num_positions);
+        assert(memcmp(actual->positions, expected->positions, expected->num_positions * sizeof(size_t)) == 0);
+    }
+
+    free_hash_table(serial);
+    free_token_sequence(sequence);
+    free_tokenizer(&tokenizer);
+    printf("Parallel pair count test passed\n");
+}
+
+void test_BPE_from_dataset_matches_single_file() {
+    printf("Testing BPE over a dataset...\n");
+    const char* lines[] = {"the cat sat on the mat.", "aaaa banana bandana,", "the hat that sat", "a bat"};
+    Dataset* dataset = create_dataset(2);
+    add_category_to_dataset(dataset, "first");
+    add_category_to_dataset(dataset, "second");
+    TextFile* joined = create_text_file("test_joined.txt", 1024);
+    open_text_file(joined, "w");
+    for (size_t i = 0; i < 4; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "test_part_%zu.txt", i);
+        Category* category = dataset->categories[i / 2];
+        add_file_to_category(category, path);
+        TextFile* part = category->files[category->num_files - 1];
+        open_text_file(part, "w");
+        add_line_to_file(part, lines[i]);
+        close_text_file(part);
+        add_line_to_file(joined, lines[i]);
+    }
+    close_text_file(joined);
+
+    Tokenizer* single = create_tokenizer(100);
+    Tokenizer* parallel = create_tokenizer(100);
+    parallel->num_threads = 3;
+    BPE(single, joined);
+    BPE_from_dataset(parallel, dataset);
+
+    assert(single->vocab_size > 0);
+    assert(single->num_merges == parallel->num_merges);
+    assert_same_vocabulary(single, parallel);
+
+    for (size_t i = 0; i < 4; i++) {
+        remove(dataset->categories[i / 2]->files[i % 2]->filepath);
+    }
+    remove(joined->filepath);
+    free_tokenizer(&single);
+    free_tokenizer(&parallel);
+    destroy_text_file(&joined);
+    free_dataset(dataset);
+    printf("Dataset BPE test passed\n");
+}
+
+void test_BPE_streaming_matches_in_memory() {
+    printf("Testing streaming BPE with spilled runs...\n");
+    TextFile* file = create_text_file("test_temp.txt", 1024);
+    open_text_file(file, "w");
+    add_line_to_file(file, "the cat sat on the mat. aaaa banana bandana,");
+    add_line_to_file(file, "the hat that sat  on a bat");
+    add_line_to_file(file, "");
+    add_line_to_file(file, "bandana banana the end");
+    close_text_file(file);
+
+    Tokenizer* in_memory = create_tokenizer(100);
+    Tokenizer* streaming = create_tokenizer(100);
+    // Tiny chunks cut words at chunk edges and a small word limit forces
+    // several runs through the external merge.
+    streaming->stream_chunk_size = 5;
+    streaming->max_words_in_memory = 3;
+    BPE(in_memory, file);
+    BPE_streaming(streaming, file);
+
+    assert(in_memory->vocab_size > 0);
+    assert(in_memory->num_merges == streaming->num_merges);
+    assert_same_vocabulary(in_memory, streaming);
+
+    free_tokenizer(&in_memory);
+    free_tokenizer(&streaming);
+    destroy_text_file(&file);
+
+    // A directory opens but cannot be read: a read error, not an empty file.
+    TextFile* unreadable = create_text_file(".", 1024);
+    assert(count_words_streaming(unreadable, 5, 0, PRETOKENIZE_SPACES) == NULL);
+    assert(count_words(unreadable, PRETOKENIZE_SPACES) == NULL);
+    destroy_text_file(&unreadable);
+    printf("Streaming BPE test passed\n");
+}
+
+// Writes a copy of the checkpoint at path with length bytes, the byte at
+// offset (if below length) set to value, and checks it is rejected.
+static void assert_corrupt_checkpoint_rejected(const char* path, size_t length, size_t offset, unsigned char value) {
+    FILE* file = fopen(path, "rb");
+    assert(file != NULL);
+    unsigned char* bytes = calloc(length, 1);
+    assert(bytes != NULL);
+    size_t read = fread(bytes, 1, length, file);
+    fclose(file);
+    (void)read;
+    if (offset < length) {
+        bytes[offset] = value;
+    }
+    file = fopen("test_checkpoint_bad.bin", "wb");
+    assert(file != NULL && fwrite(bytes, 1, length, file) == length);
+    fclose(file);
+    free(bytes);
+    Tokenizer* tokenizer = create_tokenizer(100);
+    assert(load_checkpoint(tokenizer, "test_checkpoint_bad.bin") == NULL);
+    free_tokenizer(&tokenizer);
+    remove("test_checkpoint_bad.bin");
+}
+
+void test_BPE_resume_from_checkpoint() {
+    printf("Testing BPE checkpoint and resume...\n");
+    TextFile* file = create_test_file("the cat sat on the mat. aaaa banana bandana, the hat that sat");
+    Tokenizer* full = create_tokenizer(100);
+    assert(set_checkpointing(full, "test_checkpoint.bin", 4, 0) == 0);
+    BPE(full, file);
+    assert(full->num_merges > 4 && full->num_merges % 4 != 0);
+
+    // The last checkpoint is from before the final merges; resuming from it
+    // must end in the same state as the uninterrupted run.
+    Tokenizer* resumed = create_tokenizer(100);
+    TokenSequence* sequence = load_checkpoint(resumed, "test_checkpoint.bin");
+    assert(sequence != NULL);
+    assert(resumed->num_merges == full->num_merges / 4 * 4);
+    free_token_sequence(sequence);
+    free_tokenizer(&resumed);
+
+    resumed = create_tokenizer(100);
+    assert(BPE_resume(resumed, "test_checkpoint.bin") == 0);
+    assert(resumed->num_merges == full->num_merges);
+    assert_same_merges(full, resumed);
+    assert_same_vocabulary(full, resumed);
+
+    // A tokenizer of another size cannot use the checkpoint.
+    Tokenizer* other = create_tokenizer(50);
+    assert(BPE_resume(other, "test_checkpoint.bin") != 0);
+
+    // Damaged checkpoints are rejected rather than trusted. The sequence
+    // ends the file: ids, weights, prev, then next.
+    Tokenizer* probe = create_tokenizer(100);
+    sequence = load_checkpoint(probe, "test_checkpoint.bin");
+    assert(sequence != NULL && sequence->size > 0);
+    size_t size = sequence->size;
+    free_token_sequence(sequence);
+    free_tokenizer(&probe);
+    FILE* saved = fopen("test_checkpoint.bin", "rb");
+    fseek(saved, 0, SEEK_END);
+    size_t length = (size_t)ftell(saved);
+    fclose(saved);
+    size_t ids = length - size * (sizeof(uint32_t) + 3 * sizeof(size_t));
+    assert_corrupt_checkpoint_rejected("test_checkpoint.bin", length - 1, length, 0);   // truncated
+    assert_corrupt_checkpoint_rejected("test_checkpoint.bin", length + 1, length, 0);   // trailing byte
+    assert_corrupt_checkpoint_rejected("test_checkpoint.bin", length, ids + 3, 0x7F);   // id out of range
+    assert_corrupt_checkpoint_rejected("test_checkpoint.bin", length, length - 1, 0x7F); // next out of range
+    assert_corrupt_checkpoint_rejected("test_checkpoint.bin", length, ids - 1, 0x7F);   // live > size
+
+    remove("test_checkpoint.bin");
+    free_tokenizer(&other);
+    free_tokenizer(&full);
+    free_tokenizer(&resumed);
+
+    // The training mode comes back from the checkpoint, even into a default
+    // tokenizer.
+    full = create_tokenizer(400);
+    full->byte_level = true;
+    full->pretokenizer = PRETOKENIZE_GPT2;
+    assert(set_checkpointing(full, "test_checkpoint.bin", 4, 0) == 0);
+    BPE(full, file);
+    assert(full->num_merges > 4 && full->num_merges % 4 != 0);
+    resumed = create_tokenizer(400);
+    assert(BPE_resume(resumed, "test_checkpoint.bin") == 0);
+    assert(resumed->byte_level && resumed->pretokenizer == PRETOKENIZE_GPT2);
+    assert_same_merges(full, resumed);
+    assert_same_vocabulary(full, resumed);
+
+    remove("test_checkpoint.bin");
+    free_tokenizer(&full);
+    free_tokenizer(&resumed);
+    destroy_text_file(&file);
+    printf("Checkpoint resume test passed\n");
+}
+
+void test_BPE_batched_merges_match_single_merges() {
+    printf("Testing batched merge passes...\n");
+    TextFile* file = create_test_file("the cat sat on the mat. aaaa banana bandana, the hat that sat");
+    Tokenizer* single = create_tokenizer(100);
+    Tokenizer* batched = create_tokenizer(100);
+    single->incremental_pairs = false;
+    batched->incremental_pairs = false;
+    batched->merges_per_pass = 8;
+
+    BPE(single, file);
+    BPE(batched, file);
+
+    assert(single->num_merges > 0);
+    assert_same_merges(single, batched);
+    assert_same_vocabulary(single, batched);
+
+    free_tokenizer(&single);
+    free_tokenizer(&batched);
+    destroy_text_file(&file);
+    printf("Batched merge test passed\n");
+}
+
+void test_BPE_byte_level() {
+    printf("Testing byte-level BPE...\n");
+    TextFile* file = create_test_file("aa aa aa aa aa b");
+    Tokenizer* tokenizer = create_tokenizer(300);
+    tokenizer->byte_level = true;
+
+    BPE(tokenizer, file);
+
+    // Every byte has a token at the slot of its value.
+    assert(tokenizer->vocab_size == BYTE_ALPHABET_SIZE + 1);
+    assert_token_equals(tokenizer->vocabulary['a'], "a", 10);
+    assert_token_equals(tokenizer->vocabulary['b'], "b", 1);
+    assert_token_equals(tokenizer->vocabulary['z'], "z", 0);
+    assert(tokenizer->num_merges == 1);
+    assert(tokenizer->merges[0].left == 'a' && tokenizer->merges[0].right == 'a');
+    assert_token_equals(tokenizer->vocabulary[tokenizer->merges[0].merged], "aa", 5);
+
+    // Too small for the alphabet.
+    Tokenizer* small = create_tokenizer(100);
+    small->byte_level = true;
+    BPE(small, file);
+    assert(small->vocab_size == 0);
+
+    free_tokenizer(&small);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+
+    file = create_test_file("the cat sat on the mat. aaaa banana bandana, the hat that sat");
+    Tokenizer* corpus = create_tokenizer(400);
+    Tokenizer* words = create_tokenizer(400);
+    corpus->byte_level = words->byte_level = true;
+    corpus->deduplicate_words = false;
+    BPE(corpus, file);
+    BPE(words, file);
+    assert(corpus->num_merges > 0);
+    assert_same_merges(corpus, words);
+    assert_same_vocabulary(corpus, words);
+
+    free_tokenizer(&corpus);
+    free_tokenizer(&words);
+    destroy_text_file(&file);
+
+    // Bytes of multi-byte characters pair like any other byte.
+    file = create_test_file("caf\xC3\xA9 caf\xC3\xA9 caf\xC3\xA9");
+    Tokenizer* utf8 = create_tokenizer(300);
+    utf8->byte_level = true;
+    BPE(utf8, file);
+    bool merged_e = false;
+    for (size_t m = 0; m < utf8->num_merges; m++) {
+        if (utf8->merges[m].left == 0xC3 && utf8->merges[m].right == 0xA9) merged_e = true;
+    }
+    bool found_cafe = false;
+    for (size_t i = 0; i < utf8->max_vocab_size; i++) {
+        if (utf8->vocabulary[i] && strcmp(utf8->vocabulary[i]->text, "caf\xC3\xA9") == 0) found_cafe = true;
+    }
+    assert(merged_e && found_cafe);
+    free_tokenizer(&utf8);
+    destroy_text_file(&file);
+    printf("Byte-level BPE test passed\n");
+}
+
+void test_BPE_utf8_characters() {
+    printf("Testing BPE on UTF-8 text...\n");
+    TextFile* file = create_test_file("caf\xC3\xA9 caf\xC3\xA9 na\xC3\xAFve caf\xC3\xA9 \xE2\x82\xAC\xE2\x82\xAC");
+    Tokenizer* corpus = create_tokenizer(100);
+    Tokenizer* words = create_tokenizer(100);
+    corpus->deduplicate_words = false;
+
+    BPE(corpus, file);
+    BPE(words, file);
+
+    // Multi-byte characters are single base tokens and can be merged.
+    bool found_e = false, found_cafe = false;
+    for (size_t i = 0; i < corpus->max_vocab_size; i++) {
+        Token* token = corpus->vocabulary[i];
+        if (!token) continue;
+        if (strcmp(token->text, "\xC3\xA9") == 0 && token->frequency == 3) found_e = true;
+        if (strcmp(token->text, "caf\xC3\xA9") == 0) found_cafe = true;
+        assert(strcmp(token->text, "\xC3") != 0);
+    }
+    assert(found_e && found_cafe);
+    assert_same_merges(corpus, words);
+    assert_same_vocabulary(corpus, words);
+
+    free_tokenizer(&corpus);
+    free_tokenizer(&words);
+    destroy_text_file(&file);
+    printf("UTF-8 BPE test passed\n");
+}
+
+// Compares two pair tables entry by entry, positions included.
+static void assert_same_pair_counts(HashTable* expected_table, HashTable* actual_table) {
+    assert(expected_table->size == actual_table->size);
+    for (size_t i = 0; i < expected_table->capacity; i++) {
+        HashEntry* entry = expected_table->entries[i];
+        if (!entry || !entry->is_occupied) continue;
+        PairStats* expected = (PairStats*)entry->value;
+        HashEntry* found = find_hash_entry(actual_table, entry->key);
+        assert(found != NULL);
+        PairStats* actual = (PairStats*)found->value;
+        assert(actual->frequency == expected->frequency);
+        assert(actual->num_positions == expected->num_positions);
+        assert(memcmp(actual->positions, expected->positions, expected->num_positions * sizeof(size_t)) == 0);
+    }
+}
+
+// Counts the pairs of sequence with the hashed count and with the dense
+// histogram, on one and on three threads, and checks they agree.
+static void assert_dense_matches_hashed(Tokenizer* tokenizer, const TokenSequence* sequence) {
+    count_pairs(tokenizer, sequence);
+    HashTable* hashed = tokenizer->pair_freqs;
+    tokenizer->pair_freqs = create_hash_table(INITIAL_PAIR_FREQ_SIZE);
+    create_uint64_ops(tokenizer->pair_freqs);
+    tokenizer->pair_freqs->ops.free_value = free_pair_stats;
+
+    tokenizer->num_threads = 1;
+    assert(count_byte_pairs(tokenizer, sequence) == 0);
+    assert_same_pair_counts(hashed, tokenizer->pair_freqs);
+    tokenizer->num_threads = 3;
+    assert(count_byte_pairs(tokenizer, sequence) == 0);
+    assert_same_pair_counts(hashed, tokenizer->pair_freqs);
+    // The pool is reused while the thread count stays the same.
+    ThreadPool* pool = get_thread_pool(tokenizer);
+    assert(pool != NULL && pool->requested_threads == 3 && get_thread_pool(tokenizer) == pool);
+    free_hash_table(hashed);
+}
+
+void test_count_byte_pairs_matches_hashed_count() {
+    printf("Testing dense byte pair histogram...\n");
+    Tokenizer* tokenizer = create_tokenizer(300);
+    TokenSequence* sequence = create_token_sequence(16);
+    // Long enough to be split across two threads.
+    for (size_t i = 0; i < 3 * MIN_SLOTS_PER_SHARD; i++) {
+        append_to_token_sequence(sequence, (uint32_t)((i * 7919) % 97 + '!'), 1 + i % 4, i % 11 != 0);
+    }
+    assert_dense_matches_hashed(tokenizer, sequence);
+
+    // Ids past the byte range are left to the hashed count.
+    append_to_token_sequence(sequence, 300, 1, true);
+    assert(count_byte_pairs(tokenizer, sequence) != 0);
+    free_token_sequence(sequence);
+
+    // Non-ASCII text, read the way byte-level training reads it, so the
+    // histogram slots of bytes >= 0x80 are used.
+    TextFile* file = create_test_file("caf\xC3\xA9 na\xC3\xAFve \xE2\x82\xAC" "10 \xF0\x9F\x99\x82 caf\xC3\xA9 \xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E");
+    Tokenizer* bytes = create_tokenizer(300);
+    bytes->byte_level = true;
+    sequence = file_to_byte_sequence(bytes, file);
+    assert(sequence != NULL);
+    bool high_pair = false;
+    for (size_t i = 0; i < sequence->size; i++) {
+        size_t next = sequence->next[i];
+        if (next != NO_POSITION && sequence->ids[i] >= 0x80 && sequence->ids[next] >= 0x80) high_pair = true;
+    }
+    assert(high_pair);
+    assert_dense_matches_hashed(tokenizer, sequence);
+
+    free_token_sequence(sequence);
+    destroy_text_file(&file);
+
+    // A read error is not the end of the corpus.
+    file = create_text_file(".", 1024);
+    assert(file_to_byte_sequence(bytes, file) == NULL);
+    free_tokenizer(&bytes);
+    destroy_text_file(&file);
+    free_tokenizer(&tokenizer);
+    printf("Dense byte pair test passed\n");
+}
+
+void test_BPE_records_merges() {
+    printf("Testing BPE merge list...\n");
+    TextFile* file = create_test_file("aa aa aa aa aa");
+    Tokenizer* tokenizer = create_tokenizer(100);
+
+    BPE(tokenizer, file);
+
+    assert(tokenizer->num_merges == 1);
+    BPEMerge merge = tokenizer->merges[0];
+    assert(merge.left == merge.right);
+    assert(strcmp(tokenizer->vocabulary[merge.left]->text, "a") == 0);
+    assert_token_equals(tokenizer->vocabulary[merge.merged], "aa", 5);
+    assert(merge.frequency == 5);
+
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+    printf("Merge list test passed\n");
+}
+
 // Tokenizer Edge Cases
 void test_tokenizer_empty() {
     printf("Testing tokenizer with empty input...\n");
@@ -138,6 +624,17 @@ void test_BPE() {
     test_BPE_empty_input();
     test_BPE_single_character();
     test_BPE_repeated_sequence();
+    test_BPE_incremental_matches_full_recount();
+    test_BPE_deduplicated_words_match_full_corpus();
+    test_count_pairs_parallel_matches_serial();
+    test_BPE_from_dataset_matches_single_file();
+    test_BPE_streaming_matches_in_memory();
+    test_BPE_resume_from_checkpoint();
+    test_BPE_batched_merges_match_single_merges();
+    test_BPE_byte_level();
+    test_BPE_utf8_characters();
+    test_count_byte_pairs_matches_hashed_count();
+    test_BPE_records_merges();
     
     // Tokenizer Tests
     test_tokenizer_empty();
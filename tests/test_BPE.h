@@ -13,6 +13,19 @@ void test_BPE_empty_input();
 
 void test_BPE_single_character();
 void test_BPE_repeated_sequence();
+void assert_same_vocabulary(Tokenizer* a, Tokenizer* b);
+void assert_same_merges(Tokenizer* a, Tokenizer* b);
+void test_BPE_incremental_matches_full_recount();
+void test_BPE_deduplicated_words_match_full_corpus();
+void test_count_pairs_parallel_matches_serial();
+void test_BPE_from_dataset_matches_single_file();
+void test_BPE_streaming_matches_in_memory();
+void test_BPE_resume_from_checkpoint();
+void test_BPE_batched_merges_match_single_merges();
+void test_BPE_byte_level();
+void test_BPE_utf8_characters();
+void test_count_byte_pairs_matches_hashed_count();
+void test_BPE_records_merges();
 void test_tokenizer_empty();
 void test_tokenizer_max_length();
 void test_memory_leaks();
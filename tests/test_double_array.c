@@ -0,0 +1,58 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <double_array.h>
+
+void test_double_array_lookup() {
+    const char* words[] = {"a", "ab", "abc", "b", "\xC3\xA9", "\xE2\x82\xAC", "zz", "\xFF"};
+    size_t n = sizeof(words) / sizeof(words[0]);
+    DoubleArrayKey keys[8];
+    for (size_t i = 0; i < n; i++) {
+        keys[i].bytes = words[i];
+        keys[i].length = strlen(words[i]);
+        keys[i].value = (uint32_t)(100 + i);
+    }
+    DoubleArray* trie = build_double_array(keys, n);
+    assert(trie != NULL);
+    for (size_t i = 0; i < n; i++) {
+        assert(double_array_lookup(trie, words[i], strlen(words[i])) == 100 + i);
+    }
+    // Prefixes and extensions of keys are not keys.
+    assert(double_array_lookup(trie, "abcd", 4) == DOUBLE_ARRAY_NONE);
+    assert(double_array_lookup(trie, "z", 1) == DOUBLE_ARRAY_NONE);
+    assert(double_array_lookup(trie, "\xC3", 1) == DOUBLE_ARRAY_NONE);
+    assert(double_array_lookup(trie, "c", 1) == DOUBLE_ARRAY_NONE);
+    assert(double_array_lookup(trie, "", 0) == DOUBLE_ARRAY_NONE);
+    free_double_array(trie);
+}
+
+void test_double_array_many_keys() {
+    // Every two byte key over a small alphabet, so nodes compete for slots.
+    char words[400][3];
+    DoubleArrayKey keys[400];
+    size_t n = 0;
+    for (int a = 0; a < 20; a++) {
+        for (int b = 0; b < 20; b++) {
+            words[n][0] = (char)('A' + a * 3);
+            words[n][1] = (char)(' ' + b * 5);
+            words[n][2] = '\0';
+            keys[n].bytes = words[n];
+            keys[n].length = 2;
+            keys[n].value = (uint32_t)n;
+            n++;
+        }
+    }
+    DoubleArray* trie = build_double_array(keys, n);
+    assert(trie != NULL);
+    for (size_t i = 0; i < n; i++) {
+        assert(double_array_lookup(trie, words[i], 2) == i);
+        assert(double_array_lookup(trie, words[i], 1) == DOUBLE_ARRAY_NONE);
+    }
+    free_double_array(trie);
+}
+
+void run_double_array_tests() {
+    test_double_array_lookup();
+    test_double_array_many_keys();
+}
@@ -0,0 +1,436 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <encoder.h>
+#include "test_BPE.h"
+
+static uint32_t id_of(Tokenizer* tokenizer, const char* text) {
+    for (size_t i = 0; i < tokenizer->max_vocab_size; i++) {
+        if (tokenizer->vocabulary[i] && strcmp(tokenizer->vocabulary[i]->text, text) == 0) {
+            return (uint32_t)i;
+        }
+    }
+    return NO_TOKEN;
+}
+
+void test_encode_applies_merges_by_rank() {
+    TextFile* file = create_test_file("aa aa aa aa aa");
+    Tokenizer* tokenizer = create_tokenizer(100);
+    BPE(tokenizer, file);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+    assert(frozen != NULL);
+
+    uint32_t a = id_of(tokenizer, "a");
+    uint32_t aa = id_of(tokenizer, "aa");
+    uint32_t sep = id_of(tokenizer, "\x1f");
+    assert(aa != NO_TOKEN && frozen->separator == sep);
+
+    size_t n = 0;
+    uint32_t* ids = encode(frozen, "aa aa", 5, &n);
+    assert(ids && n == 3 && ids[0] == aa && ids[1] == sep && ids[2] == aa);
+    free(ids);
+
+    // Odd length: the leftmost pair merges first. Unknown characters are dropped.
+    ids = encode(frozen, "aaaz\n", 5, &n);
+    assert(ids && n == 2 && ids[0] == aa && ids[1] == a);
+    free(ids);
+
+    ids = encode(frozen, "", 0, &n);
+    assert(ids && n == 0);
+    free(ids);
+
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+void test_encode_round_trips_training_words() {
+    const char* text = "the cat sat on the mat. banana bandana, the hat that sat caf\xC3\xA9";
+    TextFile* file = create_test_file(text);
+    Tokenizer* tokenizer = create_tokenizer(200);
+    BPE(tokenizer, file);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+
+    size_t n = 0;
+    uint32_t* ids = encode_file(frozen, file, &n);
+    assert(ids != NULL);
+
+    // Decoding gives the text back, spaces included.
+    size_t length = decode(frozen, ids, n, NULL, 0);
+    assert(length == strlen(text));
+    char* decoded = malloc(length + 1);
+    assert(decode(frozen, ids, n, decoded, length + 1) == length);
+    assert(strcmp(decoded, text) == 0);
+    free(decoded);
+
+    // Merges make the frequent words shorter than their characters.
+    assert(n < strlen(text));
+
+    free(ids);
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+void test_encode_byte_level() {
+    TextFile* file = create_test_file("aa aa aa aa aa b");
+    Tokenizer* tokenizer = create_tokenizer(300);
+    tokenizer->byte_level = true;
+    BPE(tokenizer, file);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+    uint32_t aa = tokenizer->merges[0].merged;
+
+    // Bytes never seen in training still have ids.
+    size_t n = 0;
+    uint32_t* ids = encode(frozen, "aaa \xFF", 5, &n);
+    assert(ids && n == 4);
+    assert(ids[0] == aa && ids[1] == 'a' && ids[2] == ' ' && ids[3] == 0xFF);
+    free(ids);
+
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+void test_decode_truncates_like_snprintf() {
+    TextFile* file = create_test_file("abab abab abab");
+    Tokenizer* tokenizer = create_tokenizer(100);
+    BPE(tokenizer, file);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+
+    size_t n = 0;
+    uint32_t* ids = encode(frozen, "abab ab", 7, &n);
+    char buffer[8];
+    memset(buffer, '#', sizeof(buffer));
+    assert(decode(frozen, ids, n, buffer, 4) == 7);
+    assert(memcmp(buffer, "abab#", 5) == 0);  // no room for the terminator
+    assert(decode(frozen, ids, n, buffer, sizeof(buffer)) == 7);
+    assert(strcmp(buffer, "abab ab") == 0);
+
+    assert(decode(frozen, ids, 0, buffer, sizeof(buffer)) == 0 && buffer[0] == '\0');
+    uint32_t bad = (uint32_t)frozen->num_ids;
+    assert(decode(frozen, &bad, 1, buffer, sizeof(buffer)) == (size_t)-1);
+
+    free(ids);
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+void test_encode_batch_matches_encode() {
+    const char* corpus = "the cat sat on the mat. banana bandana, the hat that sat on a cat";
+    TextFile* file = create_test_file(corpus);
+    Tokenizer* tokenizer = create_tokenizer(200);
+    BPE(tokenizer, file);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+
+    const char* texts[] = {"the cat", "", "banana bandana banana", "sat", "the mat that sat", "x", "hat", "on a cat", "the"};
+    size_t num_texts = sizeof(texts) / sizeof(texts[0]);
+    size_t thread_counts[] = {1, 2, 4};
+    for (size_t c = 0; c < 3; c++) {
+        ThreadPool* pool = create_thread_pool(thread_counts[c]);
+        EncodedBatch* batch = encode_batch(frozen, texts, NULL, num_texts, pool);
+        assert(batch != NULL && batch->num_texts == num_texts);
+        for (size_t t = 0; t < num_texts; t++) {
+            size_t n = 0;
+            uint32_t* ids = encode(frozen, texts[t], strlen(texts[t]), &n);
+            assert(batch->offsets[t + 1] - batch->offsets[t] == n);
+            assert(n == 0 || memcmp(batch->ids + batch->offsets[t], ids, n * sizeof(uint32_t)) == 0);
+            free(ids);
+        }
+        free_encoded_batch(batch);
+        free_thread_pool(pool);
+    }
+
+    // No pool runs inline; an empty batch has a single offset.
+    EncodedBatch* batch = encode_batch(frozen, texts, NULL, 0, NULL);
+    assert(batch && batch->num_texts == 0 && batch->offsets[0] == 0);
+    free_encoded_batch(batch);
+
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+void test_encode_with_word_cache() {
+    const char* corpus = "the cat sat on the mat. banana bandana, the hat that sat on a cat";
+    TextFile* file = create_test_file(corpus);
+    Tokenizer* tokenizer = create_tokenizer(200);
+    BPE(tokenizer, file);
+    FrozenTokenizer* plain = freeze_tokenizer(tokenizer);
+    FrozenTokenizer* cached = freeze_tokenizer(tokenizer);
+    assert(enable_word_cache(cached, 1 << 20) == 0);
+
+    const char* texts[] = {corpus, "the the the cat", "banana zzz banana"};
+    for (size_t round = 0; round < 2; round++) {
+        for (size_t t = 0; t < 3; t++) {
+            size_t n1 = 0, n2 = 0;
+            uint32_t* expected = encode(plain, texts[t], strlen(texts[t]), &n1);
+            uint32_t* ids = encode(cached, texts[t], strlen(texts[t]), &n2);
+            assert(n1 == n2 && memcmp(expected, ids, n1 * sizeof(uint32_t)) == 0);
+            free(expected);
+            free(ids);
+        }
+    }
+    WordCacheStats stats = word_cache_stats(cached->cache);
+    assert(stats.hits > stats.misses && stats.entries > 0);
+
+    // Shared by the batch threads.
+    ThreadPool* pool = create_thread_pool(4);
+    EncodedBatch* batch = encode_batch(cached, texts, NULL, 3, pool);
+    EncodedBatch* expected = encode_batch(plain, texts, NULL, 3, NULL);
+    assert(batch && expected && batch->offsets[3] == expected->offsets[3]);
+    assert(memcmp(batch->ids, expected->ids, batch->offsets[3] * sizeof(uint32_t)) == 0);
+    free_encoded_batch(batch);
+    free_encoded_batch(expected);
+    free_thread_pool(pool);
+
+    assert(enable_word_cache(cached, 0) == 0 && cached->cache == NULL);
+    free_frozen_tokenizer(plain);
+    free_frozen_tokenizer(cached);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+void test_find_merge_rule_finds_every_merge() {
+    // "a" is the left side of many merges, so its row is searched, not scanned.
+    char corpus[512] = "";
+    for (char c = 'b'; c <= 'z'; c++) {
+        char word[8] = {'a', c, ' ', 'a', c, ' ', '\0'};
+        strcat(corpus, word);
+    }
+    TextFile* file = create_test_file(corpus);
+    Tokenizer* tokenizer = create_tokenizer(200);
+    BPE(tokenizer, file);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+    assert(tokenizer->num_merges >= 25);
+
+    for (size_t r = 0; r < tokenizer->num_merges; r++) {
+        const BPEMerge* merge = &tokenizer->merges[r];
+        const MergeRule* rule = find_merge_rule(frozen, merge->left, merge->right);
+        assert(rule != NULL && rule->rank == r && rule->merged == merge->merged);
+    }
+    assert(find_merge_rule(frozen, id_of(tokenizer, "a"), id_of(tokenizer, "a")) == NULL);
+    assert(find_merge_rule(frozen, (uint32_t)frozen->num_ids, 0) == NULL);
+
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+typedef struct {
+    uint32_t ids[512];
+    size_t size;
+    size_t calls;
+} CollectedIds;
+
+static int collect_ids(void* context, const uint32_t* ids, size_t num_ids) {
+    CollectedIds* collected = (CollectedIds*)context;
+    assert(collected->size + num_ids <= 512);
+    memcpy(collected->ids + collected->size, ids, num_ids * sizeof(uint32_t));
+    collected->size += num_ids;
+    collected->calls++;
+    return 0;
+}
+
+static int stop_after_first_chunk(void* context, const uint32_t* ids, size_t num_ids) {
+    (void)ids;
+    (void)num_ids;
+    ((CollectedIds*)context)->calls++;
+    return 1;
+}
+
+void test_encode_stream_matches_encode() {
+    const char* corpus = "the cat sat on the mat.  banana bandana, the hat that sat on a cat";
+    TextFile* file = create_test_file(corpus);
+    Tokenizer* tokenizer = create_tokenizer(200);
+    BPE(tokenizer, file);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+
+    size_t n = 0;
+    uint32_t* expected = encode(frozen, corpus, strlen(corpus), &n);
+    // Chunk sizes that cut words at every possible offset. The longest word
+    // is 8 bytes; longer words would be split at chunk_size.
+    for (size_t chunk_size = 8; chunk_size <= 20; chunk_size++) {
+        CollectedIds collected = {.size = 0, .calls = 0};
+        assert(encode_stream(frozen, file, chunk_size, collect_ids, &collected) == 0);
+        assert(collected.size == n && memcmp(collected.ids, expected, n * sizeof(uint32_t)) == 0);
+    }
+    CollectedIds stopped = {.size = 0, .calls = 0};
+    assert(encode_stream(frozen, file, 8, stop_after_first_chunk, &stopped) == -1);
+    assert(stopped.calls == 1);
+
+    // A directory opens but cannot be read: a read error, not an empty file.
+    TextFile* unreadable = create_text_file(".", 1024);
+    CollectedIds none = {.size = 0, .calls = 0};
+    assert(encode_stream(frozen, unreadable, 8, collect_ids, &none) == -1);
+    destroy_text_file(&unreadable);
+
+    free(expected);
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+void test_encode_into_caller_buffer() {
+    const char* corpus = "the cat sat on the mat. banana bandana, the hat that sat on a cat";
+    TextFile* file = create_test_file(corpus);
+    Tokenizer* tokenizer = create_tokenizer(200);
+    BPE(tokenizer, file);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+    EncodeArena* arena = create_encode_arena();
+    assert(arena != NULL);
+
+    size_t n = 0;
+    uint32_t* expected = encode(frozen, corpus, strlen(corpus), &n);
+    uint32_t ids[256];
+    assert(encode_into(frozen, corpus, strlen(corpus), ids, NULL, 256, arena) == n);
+    assert(memcmp(ids, expected, n * sizeof(uint32_t)) == 0);
+
+    // Too small: the needed size is reported and the prefix is written.
+    uint32_t small[4] = {0};
+    assert(encode_into(frozen, corpus, strlen(corpus), small, NULL, 3, arena) == n);
+    assert(memcmp(small, expected, 3 * sizeof(uint32_t)) == 0 && small[3] == 0);
+    assert(encode_into(frozen, corpus, strlen(corpus), NULL, NULL, 0, arena) == n);
+
+    // Once warm, the arena is reused as is.
+    uint32_t* arena_ids = arena->ids;
+    size_t arena_capacity = arena->capacity;
+    for (int round = 0; round < 3; round++) {
+        assert(encode_into(frozen, "banana the cat", 14, ids, NULL, 256, arena) != (size_t)-1);
+    }
+    assert(arena->ids == arena_ids && arena->capacity == arena_capacity);
+
+    free(expected);
+    free_encode_arena(arena);
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+void test_encode_gpt2_pretokenizer() {
+    const char* corpus = "the cat sat on the mat. the cat's hat, the bat's hat!  the end";
+    TextFile* file = create_test_file(corpus);
+    for (int byte_level = 0; byte_level <= 1; byte_level++) {
+        Tokenizer* tokenizer = create_tokenizer(400);
+        tokenizer->byte_level = byte_level;
+        tokenizer->pretokenizer = PRETOKENIZE_GPT2;
+        BPE(tokenizer, file);
+        // Spaces are part of the pre-tokens, so they merge with the word after them.
+        assert(id_of(tokenizer, " the") != NO_TOKEN && id_of(tokenizer, "'s") != NO_TOKEN);
+        FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+        assert(frozen->separator == NO_TOKEN);
+
+        size_t n = 0;
+        uint32_t* ids = encode(frozen, corpus, strlen(corpus), &n);
+        char decoded[128];
+        assert(ids && decode(frozen, ids, n, decoded, sizeof(decoded)) == strlen(corpus));
+        assert(strcmp(decoded, corpus) == 0);
+
+        for (size_t chunk_size = 8; chunk_size <= 20; chunk_size += 4) {
+            CollectedIds collected = {.size = 0, .calls = 0};
+            assert(encode_stream(frozen, file, chunk_size, collect_ids, &collected) == 0);
+            // The line is cut into chunk sized pieces, but still decodes back.
+            assert(decode(frozen, collected.ids, collected.size, decoded, sizeof(decoded)) == strlen(corpus));
+            assert(strcmp(decoded, corpus) == 0);
+        }
+        CollectedIds collected = {.size = 0, .calls = 0};
+        assert(encode_stream(frozen, file, STREAM_CHUNK_SIZE, collect_ids, &collected) == 0);
+        assert(collected.size == n && memcmp(collected.ids, ids, n * sizeof(uint32_t)) == 0);
+
+        // Training on the full sequence learns the same merges.
+        Tokenizer* full = create_tokenizer(400);
+        full->byte_level = byte_level;
+        full->pretokenizer = PRETOKENIZE_GPT2;
+        full->deduplicate_words = false;
+        BPE(full, file);
+        assert(full->num_merges == tokenizer->num_merges);
+
+        free(ids);
+        free_tokenizer(&full);
+        free_frozen_tokenizer(frozen);
+        free_tokenizer(&tokenizer);
+    }
+    destroy_text_file(&file);
+}
+
+// Every id must cover exactly the bytes it decodes to; separators cover the
+// spaces between words.
+static void assert_offsets_match_text(const FrozenTokenizer* frozen, const char* text, const uint32_t* ids, const TokenOffset* offsets, size_t n) {
+    size_t previous_end = 0;
+    for (size_t i = 0; i < n; i++) {
+        assert(offsets[i].start >= previous_end && offsets[i].end > offsets[i].start && offsets[i].end <= strlen(text));
+        if (ids[i] == frozen->separator) {
+            for (size_t b = offsets[i].start; b < offsets[i].end; b++) {
+                assert(text[b] == ' ' || text[b] == '\n');
+            }
+        } else {
+            char piece[64];
+            size_t length = decode(frozen, &ids[i], 1, piece, sizeof(piece));
+            assert(length == offsets[i].end - offsets[i].start && memcmp(piece, text + offsets[i].start, length) == 0);
+        }
+        previous_end = offsets[i].end;
+    }
+}
+
+void test_encode_with_offsets() {
+    const char* corpus = "the cat sat on the mat. banana bandana, the hat that sat caf\xC3\xA9";
+    TextFile* file = create_test_file(corpus);
+    for (int byte_level = 0; byte_level <= 1; byte_level++) {
+        Tokenizer* tokenizer = create_tokenizer(400);
+        tokenizer->byte_level = byte_level;
+        BPE(tokenizer, file);
+        FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+
+        // Q and ! are not in the vocabulary in character mode, so they
+        // leave gaps between the offsets.
+        const char* text = "the  cat\nsat Qbanana! caf\xC3\xA9";
+        size_t n = 0, n_plain = 0;
+        TokenOffset* offsets = NULL;
+        uint32_t* ids = encode_with_offsets(frozen, text, strlen(text), &n, &offsets);
+        uint32_t* plain = encode(frozen, text, strlen(text), &n_plain);
+        assert(ids && offsets && n == n_plain && memcmp(ids, plain, n * sizeof(uint32_t)) == 0);
+        assert_offsets_match_text(frozen, text, ids, offsets, n);
+
+        // Cached words get the same offsets, including the ones with gaps.
+        assert(enable_word_cache(frozen, 1 << 16) == 0);
+        for (int round = 0; round < 2; round++) {
+            size_t n_cached = 0;
+            TokenOffset* cached_offsets = NULL;
+            uint32_t* cached = encode_with_offsets(frozen, text, strlen(text), &n_cached, &cached_offsets);
+            assert(n_cached == n && memcmp(cached_offsets, offsets, n * sizeof(TokenOffset)) == 0);
+            free(cached);
+            free(cached_offsets);
+        }
+
+        EncodeArena* arena = create_encode_arena();
+        uint32_t into_ids[64];
+        TokenOffset into_offsets[64];
+        assert(encode_into(frozen, text, strlen(text), into_ids, into_offsets, 64, arena) == n);
+        assert(memcmp(into_offsets, offsets, n * sizeof(TokenOffset)) == 0);
+        assert(encode_into(frozen, text, strlen(text), into_ids, into_offsets, 2, arena) == n);
+
+        free_encode_arena(arena);
+        free(ids);
+        free(plain);
+        free(offsets);
+        free_frozen_tokenizer(frozen);
+        free_tokenizer(&tokenizer);
+    }
+    destroy_text_file(&file);
+}
+
+void run_encoder_tests() {
+    test_encode_applies_merges_by_rank();
+    test_encode_round_trips_training_words();
+    test_encode_byte_level();
+    test_decode_truncates_like_snprintf();
+    test_encode_batch_matches_encode();
+    test_encode_with_word_cache();
+    test_find_merge_rule_finds_every_merge();
+    test_encode_stream_matches_encode();
+    test_encode_into_caller_buffer();
+    test_encode_gpt2_pretokenizer();
+    test_encode_with_offsets();
+}
@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pretokenizer.h>
+
+// Checks next_word_span against strtok on a copy of text.
+static void assert_same_splits_as_strtok(const char* text, const char* delimiters) {
+    DelimiterSet set;
+    make_delimiter_set(&set, delimiters);
+    char* copy = strdup(text);
+    size_t length = strlen(text);
+    size_t position = 0;
+    WordSpan span;
+    for (char* word = strtok(copy, delimiters); word != NULL; word = strtok(NULL, delimiters)) {
+        assert(next_word_span(&set, text, length, &position, &span));
+        assert(span.offset == (size_t)(word - copy) && span.length == strlen(word));
+    }
+    assert(!next_word_span(&set, text, length, &position, &span));
+    free(copy);
+}
+
+void test_pretokenizer_matches_strtok() {
+    const char* delimiter_sets[] = {" ", " \n", ",.;", " \t\n\r.,;:!?-()"};  // the last one is above the SIMD limit
+    char text[200];
+    srand(7);
+    for (size_t d = 0; d < 4; d++) {
+        const char* delimiters = delimiter_sets[d];
+        assert_same_splits_as_strtok("", delimiters);
+        assert_same_splits_as_strtok(delimiters, delimiters);
+        for (int round = 0; round < 200; round++) {
+            // Mostly letters with delimiters sprinkled in, so words cross
+            // the 16 and 32 byte blocks at many offsets.
+            size_t length = (size_t)(rand() % 199);
+            for (size_t i = 0; i < length; i++) {
+                int r = rand() % 8;
+                text[i] = r == 0 ? delimiters[rand() % strlen(delimiters)] : (char)('a' + rand() % 26);
+            }
+            text[length] = '\0';
+            assert_same_splits_as_strtok(text, delimiters);
+        }
+    }
+}
+
+void test_delimiter_set() {
+    DelimiterSet set;
+    make_delimiter_set(&set, " ,, \xFF");
+    assert(set.num_bytes == 3);
+    assert(is_delimiter(&set, ' ') && is_delimiter(&set, ',') && is_delimiter(&set, 0xFF));
+    assert(!is_delimiter(&set, 'a') && !is_delimiter(&set, '\0'));
+}
+
+// Checks that next_gpt2_span cuts text into exactly the expected pieces.
+static void assert_gpt2_pieces(const char* text, const char* const* expected, size_t num_expected) {
+    Pretokenizer pretokenizer;
+    init_pretokenizer(&pretokenizer, PRETOKENIZE_GPT2, NULL, text, strlen(text));
+    WordSpan span;
+    for (size_t i = 0; i < num_expected; i++) {
+        assert(next_gpt2_span(&pretokenizer, &span));
+        assert(span.length == strlen(expected[i]) && memcmp(text + span.offset, expected[i], span.length) == 0);
+    }
+    assert(!next_gpt2_span(&pretokenizer, &span));
+}
+
+void test_gpt2_pretokenizer() {
+    const char* words[] = {"Hello", " world", "'s", " 123", " ", " x", "!!"};
+    assert_gpt2_pieces("Hello world's 123  x!!", words, 7);
+    const char* contractions[] = {"we", "'re", " it", "'ll", " don", "'t", " '", "S"};
+    assert_gpt2_pieces("we're it'll don't 'S", contractions, 8);
+    // Newlines end pre-tokens and are dropped; trailing spaces stay together.
+    const char* lines[] = {"a", "  ", "b", "\t", " c"};
+    assert_gpt2_pieces("a  \n\nb\t c\n", lines, 5);
+    // Multi-byte characters join letter runs, invalid bytes stand apart.
+    const char* utf8[] = {"caf\xC3\xA9", " \xFF", "x"};
+    assert_gpt2_pieces("caf\xC3\xA9 \xFFx", utf8, 3);
+    assert_gpt2_pieces("", NULL, 0);
+    assert_gpt2_pieces("\n\n", NULL, 0);
+
+    // The same pieces after a line of every length up to two blocks, so
+    // each rule meets the block boundaries at every offset.
+    const char* sample = "we're  caf\xC3\xA9\xE2\x82\xAC it'llo\t x \xFF'd 42!!  ";
+    const char* sample_pieces[] = {"", "we", "'re", " ", " caf\xC3\xA9\xE2\x82\xAC", " it", "'ll", "o", "\t",
+                                   " x", " \xFF'", "d", " 42", "!!", "  "};
+    char shifted[2 * PRETOKEN_BLOCK_SIZE + 64];
+    for (size_t prefix = 1; prefix <= 2 * PRETOKEN_BLOCK_SIZE; prefix++) {
+        char line[2 * PRETOKEN_BLOCK_SIZE + 1];
+        memset(line, 'a', prefix);
+        line[prefix] = '\0';
+        snprintf(shifted, sizeof(shifted), "%s\n%s", line, sample);
+        sample_pieces[0] = line;
+        assert_gpt2_pieces(shifted, sample_pieces, 15);
+    }
+
+    // Long letter runs go through the block scan; every byte is covered once.
+    char text[300];
+    srand(11);
+    for (int round = 0; round < 200; round++) {
+        size_t length = (size_t)(rand() % 299);
+        for (size_t i = 0; i < length; i++) {
+            int r = rand() % 24;
+            text[i] = r == 0 ? ' ' : r == 1 ? '7' : r == 2 ? '.' : r == 3 ? '\n' : (char)((r & 1 ? 'a' : 'A') + rand() % 26);
+        }
+        text[length] = '\0';
+        size_t covered = 0;
+        Pretokenizer pretokenizer;
+        init_pretokenizer(&pretokenizer, PRETOKENIZE_GPT2, NULL, text, length);
+        WordSpan span;
+        while (next_gpt2_span(&pretokenizer, &span)) {
+            assert(span.length > 0 && span.offset >= covered);
+            for (size_t i = covered; i < span.offset; i++) {
+                assert(text[i] == '\n');
+            }
+            for (size_t i = 0; i < span.length; i++) {
+                assert(text[span.offset + i] != '\n');
+            }
+            covered = span.offset + span.length;
+        }
+        for (size_t i = covered; i < length; i++) {
+            assert(text[i] == '\n');
+        }
+    }
+}
+
+void run_pretokenizer_tests() {
+    test_delimiter_set();
+    test_pretokenizer_matches_strtok();
+    test_gpt2_pretokenizer();
+}
@@ -0,0 +1,52 @@
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <priority_queue.h>
+
+static int compare_strings(const void* a, const void* b) {
+    return strcmp((const char*)a, (const char*)b);
+}
+
+void test_priority_queue_order() {
+    PriorityQueue* queue = create_priority_queue(2, compare_strings);
+    assert(queue != NULL);
+
+    size_t priorities[] = {3, 9, 1, 9, 4, 7};
+    char* items[] = {"c", "z", "a", "b", "d", "e"};
+    for (size_t i = 0; i < 6; i++) {
+        assert(push_priority_queue(queue, priorities[i], items[i]) == 0);
+    }
+    assert(queue->size == 6);
+
+    // Highest priority first, ties broken by compare_items.
+    const char* expected[] = {"b", "z", "e", "d", "c", "a"};
+    HeapNode node;
+    for (size_t i = 0; i < 6; i++) {
+        assert(pop_priority_queue(queue, &node));
+        assert(strcmp((const char*)node.item, expected[i]) == 0);
+    }
+    assert(!pop_priority_queue(queue, &node));
+    free_priority_queue(queue);
+}
+
+void test_priority_queue_heapify() {
+    PriorityQueue* queue = create_priority_queue(4, NULL);
+    for (size_t i = 0; i < 100; i++) {
+        append_priority_queue(queue, (i * 37) % 101, NULL);
+    }
+    heapify_priority_queue(queue);
+
+    HeapNode node;
+    size_t last = (size_t)-1;
+    while (pop_priority_queue(queue, &node)) {
+        assert(node.priority <= last);
+        last = node.priority;
+    }
+    free_priority_queue(queue);
+}
+
+void run_priority_queue_tests() {
+    test_priority_queue_order();
+    test_priority_queue_heapify();
+}
@@ -5,6 +5,14 @@
 // Declare the functions to run dataset and hash table tests
 void run_dataset_tests();
 void run_hash_table_tests();
+void run_priority_queue_tests();
+void run_thread_pool_tests();
+void run_utf8_tests();
+void run_encoder_tests();
+void run_word_cache_tests();
+void run_double_array_tests();
+void run_pretokenizer_tests();
+void run_token_shard_tests();
 
 void test_add_to_vocabulary();
 void test_free_tokenizer();
@@ -19,6 +27,30 @@ int main() {
     printf("Running Hash Table Tests...\n");
     run_hash_table_tests();
 
+    printf("Running Priority Queue Tests...\n");
+    run_priority_queue_tests();
+
+    printf("Running Thread Pool Tests...\n");
+    run_thread_pool_tests();
+
+    printf("Running UTF-8 Tests...\n");
+    run_utf8_tests();
+
+    printf("Running Encoder Tests...\n");
+    run_encoder_tests();
+
+    printf("Running Word Cache Tests...\n");
+    run_word_cache_tests();
+
+    printf("Running Double-Array Trie Tests...\n");
+    run_double_array_tests();
+
+    printf("Running Pre-tokenizer Tests...\n");
+    run_pretokenizer_tests();
+
+    printf("Running Token Shard Tests...\n");
+    run_token_shard_tests();
+
     printf("Running Free Tokenizer Memory Tests....\n");
     //test_memory_leak();
     //test_create_tokenizer_memory_leak();
@@ -0,0 +1,41 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread_pool.h>
+
+static void record_index(void* context, size_t index) {
+    size_t* runs = (size_t*)context;
+    runs[index]++;
+}
+
+void test_thread_pool_runs_every_index_once() {
+    size_t runs[257] = {0};
+    ThreadPool* pool = create_thread_pool(4);
+    assert(pool != NULL && pool->requested_threads == 4);
+
+    // Several batches on the same pool.
+    for (size_t batch = 1; batch <= 3; batch++) {
+        assert(run_thread_pool(pool, 257, record_index, runs) == 0);
+        for (size_t i = 0; i < 257; i++) {
+            assert(runs[i] == batch);
+        }
+    }
+    assert(run_thread_pool(pool, 0, record_index, runs) == 0);
+    free_thread_pool(pool);
+}
+
+void test_thread_pool_single_thread() {
+    size_t runs[8] = {0};
+    ThreadPool* pool = create_thread_pool(1);
+    assert(pool != NULL && pool->num_threads == 1);
+    assert(run_thread_pool(pool, 8, record_index, runs) == 0);
+    for (size_t i = 0; i < 8; i++) {
+        assert(runs[i] == 1);
+    }
+    free_thread_pool(pool);
+}
+
+void run_thread_pool_tests() {
+    test_thread_pool_runs_every_index_once();
+    test_thread_pool_single_thread();
+}
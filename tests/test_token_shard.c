@@ -0,0 +1,106 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <token_shard.h>
+#include "test_BPE.h"
+
+void test_export_file_shards() {
+    const char* corpus = "the cat sat on the mat. banana bandana, the hat that sat on a cat";
+    TextFile* file = create_test_file(corpus);
+    Tokenizer* tokenizer = create_tokenizer(200);
+    BPE(tokenizer, file);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+    size_t n = 0;
+    uint32_t* expected = encode_file(frozen, file, &n);
+    assert(expected != NULL && n > 0);
+
+    ShardDtype dtypes[] = {SHARD_DTYPE_UINT16, SHARD_DTYPE_UINT32};
+    for (size_t d = 0; d < 2; d++) {
+        assert(export_file_shards(frozen, file, "test_shard", dtypes[d], 0) == 1);
+        TokenShard* shard = open_token_shard("test_shard_00000.bin");
+        assert(shard != NULL);
+        assert(shard->header->dtype == dtypes[d] && shard->header->vocab_size == frozen->num_ids);
+        assert(shard->header->num_tokens == n && shard->header->num_documents == 1);
+        assert(shard->documents[0] == 0 && shard->documents[1] == n);
+        assert((size_t)((const char*)shard->tokens - (const char*)shard->map) % SHARD_ALIGNMENT == 0);
+        for (size_t i = 0; i < n; i++) {
+            assert(token_shard_id(shard, i) == expected[i]);
+        }
+        close_token_shard(shard);
+    }
+    remove("test_shard_00000.bin");
+
+    // Vocabularies above 65536 ids do not fit in uint16.
+    FrozenTokenizer large = *frozen;
+    large.num_ids = 70000;
+    assert(create_shard_writer(&large, "test_shard", SHARD_DTYPE_UINT16, 0) == NULL);
+
+    // Anything else is rejected by the reader.
+    FILE* junk = fopen("test_shard_junk.bin", "wb");
+    char zeros[SHARD_ALIGNMENT] = {0};
+    fwrite(zeros, 1, sizeof(zeros), junk);
+    fclose(junk);
+    assert(open_token_shard("test_shard_junk.bin") == NULL);
+    remove("test_shard_junk.bin");
+
+    free(expected);
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    destroy_text_file(&file);
+}
+
+void test_export_dataset_shards() {
+    const char* texts[] = {"the cat sat on the mat", "banana bandana", "", "the hat that sat on a cat"};
+    Dataset* dataset = create_dataset(1);
+    add_category_to_dataset(dataset, "all");
+    Category* category = dataset->categories[0];
+    char path[64];
+    for (size_t i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "test_shard_doc%zu.txt", i);
+        add_file_to_category(category, path);
+        TextFile* part = category->files[i];
+        open_text_file(part, "w");
+        add_line_to_file(part, texts[i]);
+        close_text_file(part);
+    }
+    Tokenizer* tokenizer = create_tokenizer(200);
+    BPE_from_dataset(tokenizer, dataset);
+    FrozenTokenizer* frozen = freeze_tokenizer(tokenizer);
+
+    // A new shard starts after the document that reaches 10 tokens.
+    int num_shards = export_dataset_shards(frozen, dataset, "test_shard", SHARD_DTYPE_UINT16, 10);
+    assert(num_shards > 1);
+    size_t document = 0;
+    for (int s = 0; s < num_shards; s++) {
+        snprintf(path, sizeof(path), "test_shard_%05d.bin", s);
+        TokenShard* shard = open_token_shard(path);
+        assert(shard != NULL && shard->header->num_documents > 0);
+        for (size_t d = 0; d < shard->header->num_documents; d++, document++) {
+            size_t n = 0;
+            uint32_t* ids = encode_file(frozen, category->files[document], &n);
+            assert(shard->documents[d + 1] - shard->documents[d] == n);
+            for (size_t i = 0; i < n; i++) {
+                assert(token_shard_id(shard, shard->documents[d] + i) == ids[i]);
+            }
+            free(ids);
+        }
+        // Only the last shard may end below the limit.
+        assert(s == num_shards - 1 || shard->header->num_tokens >= 10);
+        close_token_shard(shard);
+        remove(path);
+    }
+    assert(document == 4);
+
+    for (size_t i = 0; i < 4; i++) {
+        remove(category->files[i]->filepath);
+    }
+    free_frozen_tokenizer(frozen);
+    free_tokenizer(&tokenizer);
+    free_dataset(dataset);
+}
+
+void run_token_shard_tests() {
+    test_export_file_shards();
+    test_export_dataset_shards();
+}
@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <utf8.h>
+#include <tokenizer.h>
+
+void test_utf8_char_length() {
+    assert(utf8_char_length("a", 1) == 1);
+    assert(utf8_char_length("\xC3\xA9", 2) == 2);          // é
+    assert(utf8_char_length("\xE2\x82\xAC", 3) == 3);      // €
+    assert(utf8_char_length("\xF0\x9F\x98\x80", 4) == 4);  // U+1F600
+    assert(utf8_char_length("\xC3", 1) == 0);              // truncated
+    assert(utf8_char_length("\x80", 1) == 0);              // stray continuation
+    assert(utf8_char_length("\xC0\xAF", 2) == 0);          // overlong
+    assert(utf8_char_length("\xE0\x80\xAF", 3) == 0);      // overlong
+    assert(utf8_char_length("\xED\xA0\x80", 3) == 0);      // surrogate
+    assert(utf8_char_length("\xF4\x90\x80\x80", 4) == 0);  // above U+10FFFF
+    assert(utf8_char_length("\xFF", 1) == 0);
+}
+
+void test_utf8_ascii_run() {
+    char text[100];
+    memset(text, 'x', sizeof(text));
+    // Put the first non-ASCII byte on each side of the 16 and 32 byte blocks.
+    size_t offsets[] = {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 99};
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        text[offsets[i]] = (char)0xC3;
+        assert(utf8_ascii_run(text, sizeof(text)) == offsets[i]);
+        text[offsets[i]] = 'x';
+    }
+    assert(utf8_ascii_run(text, sizeof(text)) == sizeof(text));
+}
+
+void test_utf8_validate() {
+    const char* good = "plain ascii, caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 and more ascii text";
+    size_t offset = 0;
+    assert(utf8_validate(good, strlen(good), &offset));
+    assert(utf8_count_invalid(good, strlen(good)) == 0);
+
+    const char* bad = "0123456789abcdefghij\x80xyz\xC3";
+    assert(!utf8_validate(bad, strlen(bad), &offset));
+    assert(offset == 20);
+    assert(utf8_count_invalid(bad, strlen(bad)) == 2);
+}
+
+void test_split_utf8_characters() {
+    size_t invalid = 0;
+    char** chars = split_utf8_characters("h\xC3\xA9\x80\xE2\x82\xAC!", &invalid);
+    const char* expected[] = {"h", "\xC3\xA9", "\x80", "\xE2\x82\xAC", "!"};
+    for (size_t i = 0; i < 5; i++) {
+        assert(chars[i] != NULL && strcmp(chars[i], expected[i]) == 0);
+        free(chars[i]);
+    }
+    assert(chars[5] == NULL);
+    assert(invalid == 1);
+    free(chars);
+}
+
+void run_utf8_tests() {
+    test_utf8_char_length();
+    test_utf8_ascii_run();
+    test_utf8_validate();
+    test_split_utf8_characters();
+}
@@ -0,0 +1,72 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <word_cache.h>
+
+void test_word_cache_lookup_and_insert() {
+    WordCache* cache = create_word_cache(1 << 16, 4);
+    assert(cache != NULL);
+    uint32_t ids[4];
+    uint32_t the[] = {7, 9};
+
+    assert(word_cache_lookup(cache, "the", 3, ids, 4) == WORD_CACHE_MISS);
+    assert(word_cache_insert(cache, "the", 3, the, 2) == 0);
+    assert(word_cache_lookup(cache, "the", 3, ids, 4) == 2);
+    assert(ids[0] == 7 && ids[1] == 9);
+    // Only the first length bytes are the key.
+    assert(word_cache_lookup(cache, "then", 3, ids, 4) == 2);
+    assert(word_cache_lookup(cache, "then", 4, ids, 4) == WORD_CACHE_MISS);
+    // Too little room counts as a miss.
+    assert(word_cache_lookup(cache, "the", 3, ids, 1) == WORD_CACHE_MISS);
+    // Words that encode to nothing are cached too.
+    assert(word_cache_insert(cache, "\x01", 1, NULL, 0) == 0);
+    assert(word_cache_lookup(cache, "\x01", 1, ids, 4) == 0);
+
+    WordCacheStats stats = word_cache_stats(cache);
+    assert(stats.hits == 3 && stats.misses == 3 && stats.entries == 2 && stats.evictions == 0);
+    free_word_cache(cache);
+}
+
+void test_word_cache_evicts_least_recently_used() {
+    // One shard with room for exactly three one-id entries of five bytes.
+    WordCache* probe = create_word_cache(1 << 16, 1);
+    uint32_t id = 1;
+    word_cache_insert(probe, "aaaaa", 5, &id, 1);
+    size_t entry = word_cache_stats(probe).bytes;
+    free_word_cache(probe);
+
+    WordCache* cache = create_word_cache(3 * entry, 1);
+    uint32_t ids[1];
+    const char* words[] = {"aaaaa", "bbbbb", "ccccc"};
+    for (uint32_t i = 0; i < 3; i++) {
+        assert(word_cache_insert(cache, words[i], 5, &i, 1) == 0);
+    }
+    assert(word_cache_lookup(cache, "aaaaa", 5, ids, 1) == 1);
+    id = 3;
+    assert(word_cache_insert(cache, "ddddd", 5, &id, 1) == 0);
+
+    // bbbbb was the least recently used.
+    assert(word_cache_lookup(cache, "bbbbb", 5, ids, 1) == WORD_CACHE_MISS);
+    assert(word_cache_lookup(cache, "aaaaa", 5, ids, 1) == 1 && ids[0] == 0);
+    assert(word_cache_lookup(cache, "ccccc", 5, ids, 1) == 1 && ids[0] == 2);
+    assert(word_cache_lookup(cache, "ddddd", 5, ids, 1) == 1 && ids[0] == 3);
+    WordCacheStats stats = word_cache_stats(cache);
+    assert(stats.evictions == 1 && stats.entries == 3 && stats.bytes <= 3 * entry);
+
+    // Many more words than fit, reusing the freed slots.
+    char word[16];
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(word, sizeof(word), "w%04u", i);
+        assert(word_cache_insert(cache, word, 5, &i, 1) == 0);
+    }
+    stats = word_cache_stats(cache);
+    assert(stats.entries == 3 && stats.bytes <= 3 * entry);
+    assert(word_cache_lookup(cache, "w0999", 5, ids, 1) == 1 && ids[0] == 999);
+    free_word_cache(cache);
+}
+
+void run_word_cache_tests() {
+    test_word_cache_lookup_and_insert();
+    test_word_cache_evicts_least_recently_used();
+}